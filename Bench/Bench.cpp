@@ -0,0 +1,429 @@
+//============================================================================
+// Name        : Bench.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Benchmarks for CSVFile parsing and access, and for
+//               SpookyHash.  Results are printed as tab separated values.
+//============================================================================
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "CmdOptionParser.hpp"
+#include "CSVFile.h"
+#include "CSVWriter.h"
+#include "SpookyV2.h"
+
+
+//
+// Count every allocation, so we can report allocations per row.  The
+// parsing, reading ahead and decompressing threads allocate too.
+//
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t alignment = static_cast<size_t>(align);
+    size = (size + alignment - 1) / alignment * alignment;
+    if (void *p = std::aligned_alloc(alignment, size)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+
+struct Shape
+{
+    const char *name;
+    int columns;
+    double numeric;   // the fraction of fields that are numbers
+};
+
+static const Shape shapes[] = {
+    {"wide-numeric", 159, 0.9},
+    {"wide-string", 159, 0.1},
+    {"narrow-numeric", 8, 0.9},
+    {"narrow-string", 8, 0.1},
+};
+
+
+// Writes rows of random fields, the strings mostly drawn from a handful of
+// categorical values the way our feeds repeat tickers and units.
+static size_t generate(const Shape &shape, int rows, const std::string &path)
+{
+    static const char *categories[] = {
+        "AAPL", "MSFT", "CL", "NG", "NYSE", "NASDAQ", "CME", "USD", "bbl",
+        "MMBtu"
+    };
+
+    std::mt19937 random{12345};
+    std::uniform_real_distribution<double> chance{0.0, 1.0};
+    std::uniform_real_distribution<double> price{-10000.0, 10000.0};
+    std::ofstream out{path};
+
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < shape.columns; ++column) {
+            if (column > 0) {
+                out << '\t';
+            }
+
+            if (chance(random) < shape.numeric) {
+                out << price(random);
+            }
+            else if (chance(random) < 0.8) {
+                out << categories[random() % 10];
+            }
+            else {
+                out << "id-" << random();
+            }
+        }
+        out << '\n';
+    }
+
+    return out.tellp();
+}
+
+
+//
+// Reporting
+//
+static void header() {
+    std::cout << "benchmark\tshape\tseconds\tMB/s\trows/s\tallocs/row\n";
+}
+
+static void report(const std::string &name, const std::string &shape,
+                   double seconds, double bytes, double rows,
+                   size_t allocations)
+{
+    std::cout << name << '\t' << shape << '\t' << seconds << '\t'
+              << (bytes > 0 ? bytes / seconds / 1e6 : 0.0) << '\t'
+              << (rows > 0 ? rows / seconds : 0.0) << '\t'
+              << (rows > 0 ? allocations / rows : 0.0) << '\n';
+}
+
+// Times one call of run, also counting the allocations it makes.
+template <typename Function>
+static double measure(Function run, size_t &allocations) {
+    size_t before = g_allocations.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+
+    run();
+
+    auto stop = std::chrono::steady_clock::now();
+    allocations = g_allocations.load(std::memory_order_relaxed) - before;
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+
+// The threads a load with threads = 0 parses on, which the threaded
+// results are named with: on a single core they are the same as the rest.
+static unsigned benchThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+static void benchLoad(const Shape &shape, const std::string &path,
+                      size_t bytes)
+{
+    struct Mode
+    {
+        std::string name;
+        CSVOptions options;
+    };
+
+    std::vector<Mode> modes(10);
+    std::string threads = std::to_string(benchThreads());
+
+    modes[0].name = "load-stream";
+    modes[1].name = "load-mapped";
+    modes[1].options.mapped = true;
+    modes[2].name = "load-arena";
+    modes[2].options.arena = true;
+    modes[3].name = "load-columns";
+    modes[3].options.storage = CSVStorage::Columns;
+    modes[4].name = "load-compact";
+    modes[4].options.storage = CSVStorage::Compact;
+    modes[5].name = "load-mapped-threads-" + threads;
+    modes[5].options.mapped = true;
+    modes[5].options.threads = 0;
+    modes[6].name = "load-buffered-threads-" + threads;
+    modes[6].options.threads = 0;
+    modes[7].name = "load-mapped-projected";
+    modes[7].options.mapped = true;
+    modes[7].options.columns = CSVProjection{{0, 1}};
+    modes[8].name = "load-mapped-lazy";
+    modes[8].options.mapped = true;
+    modes[8].options.storage = CSVStorage::Lazy;
+    modes[9].name = "load-direct";
+    modes[9].options.direct = true;
+
+    for (const Mode &mode : modes) {
+        size_t allocations;
+        int rows = 0;
+        double seconds = measure([&]() {
+            CSVFile csvFile{path, mode.options};
+            rows = csvFile.size();
+        }, allocations);
+
+        report(mode.name, shape.name, seconds, bytes, rows, allocations);
+    }
+}
+
+#ifdef HAVE_ZLIB
+// The same file gzipped, the way our archived feeds are.  MB/s counts the
+// bytes after decompression, to compare with the plain loads.
+static void benchCompressed(const Shape &shape, const std::string &path,
+                            size_t bytes)
+{
+    std::string gzPath = path + ".gz";
+
+    {
+        std::ifstream in{path, std::ios::binary};
+        gzFile out = gzopen(gzPath.c_str(), "wb1");
+        char buffer[1 << 16];
+
+        while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+            gzwrite(out, buffer, in.gcount());
+        }
+        gzclose(out);
+    }
+
+    CSVOptions threaded{};
+    threaded.threads = 0;
+
+    for (const CSVOptions &options : {CSVOptions{}, threaded}) {
+        size_t allocations;
+        int rows = 0;
+        double seconds = measure([&]() {
+            CSVFile csvFile{gzPath, options};
+            rows = csvFile.size();
+        }, allocations);
+
+        report(options.threads == 1
+                   ? std::string{"load-gzip"}
+                   : "load-gzip-threads-" + std::to_string(benchThreads()),
+               shape.name, seconds, bytes, rows, allocations);
+    }
+
+    std::remove(gzPath.c_str());
+}
+#endif
+
+static void benchAccess(const Shape &shape, const std::string &path)
+{
+    CSVFile csvFile{path};
+    int rows = csvFile.size();
+    size_t allocations;
+    double seconds;
+
+    // every result goes into the sink, so none of the loops can be
+    // optimized away
+    volatile size_t sink = 0;
+
+    seconds = measure([&]() {
+        for (int row = 0; row < rows; ++row) {
+            sink = sink + csvFile.getRow(row).size();
+        }
+    }, allocations);
+    report("getRow", shape.name, seconds, 0, rows, allocations);
+
+    seconds = measure([&]() {
+        for (int row = 0; row < rows; ++row) {
+            sink = sink + csvFile.getRowView(row).size();
+        }
+    }, allocations);
+    report("getRowView", shape.name, seconds, 0, rows, allocations);
+
+    int columns = std::min(csvFile.getSchema().columns(), 16);
+    seconds = measure([&]() {
+        for (int column = 0; column < columns; ++column) {
+            sink = sink + csvFile.getColumn(column).size();
+        }
+    }, allocations);
+    report("getColumn", shape.name, seconds, 0, double(rows) * columns,
+           allocations);
+
+    const int lookups = 1000000;
+    std::mt19937 random{6789};
+    std::vector<std::pair<int, int>> cells{};
+
+    for (int i = 0; i < lookups; ++i) {
+        cells.emplace_back(random() % rows, random() % shape.columns);
+    }
+
+    seconds = measure([&]() {
+        for (const std::pair<int, int> &cell : cells) {
+            sink = sink + csvFile.getCell(cell.first, cell.second).index();
+        }
+    }, allocations);
+    report("getCell", shape.name, seconds, 0, lookups, allocations);
+
+    seconds = measure([&]() {
+        for (const std::pair<int, int> &cell : cells) {
+            sink = sink +
+                   csvFile.getCellView(cell.first, cell.second).index();
+        }
+    }, allocations);
+    report("getCellView", shape.name, seconds, 0, lookups, allocations);
+
+    std::ostringstream out{};
+    seconds = measure([&]() {
+        out << csvFile;
+    }, allocations);
+    report("print", shape.name, seconds, out.str().size(), rows,
+           allocations);
+
+    std::string outputPath = path + ".out";
+    seconds = measure([&]() {
+        CSVWriter writer{outputPath};
+
+        writer.writeFile(csvFile);
+        writer.close();
+    }, allocations);
+    report("write-tsv", shape.name, seconds, MappedFile{outputPath}.size(),
+           rows, allocations);
+    std::remove(outputPath.c_str());
+}
+
+static void benchSpooky() {
+    std::vector<char> buffer(16 << 20);
+    std::mt19937 random{42};
+
+    for (char &c : buffer) {
+        c = static_cast<char>(random());
+    }
+
+    size_t allocations;
+    volatile uint64 sink = 0;
+    std::string impl = SpookyHash::Name(SpookyHash::Best());
+
+    for (size_t length : {8, 32, 128}) {
+        const size_t messages = 4000000;
+        double seconds = measure([&]() {
+            for (size_t i = 0; i < messages; ++i) {
+                sink = sink + SpookyHash::Hash64(
+                    buffer.data() + (i * length) % (buffer.size() - length),
+                    length, i);
+            }
+        }, allocations);
+
+        report("spooky-short-" + std::to_string(length), "-", seconds,
+               double(messages) * length, 0, 0);
+    }
+
+    double seconds = measure([&]() {
+        uint64 hash1 = 0, hash2 = 0;
+        SpookyHash::Hash128(buffer.data(), buffer.size(), &hash1, &hash2);
+        sink = sink + hash1;
+    }, allocations);
+    report("spooky-long", impl, seconds, buffer.size(), 0, 0);
+
+    seconds = measure([&]() {
+        uint64 hash1 = 0, hash2 = 0;
+        SpookyHash::HashTree128(buffer.data(), buffer.size(), &hash1, &hash2);
+        sink = sink + hash1;
+    }, allocations);
+    report("spooky-tree", impl, seconds, buffer.size(), 0, 0);
+
+    seconds = measure([&]() {
+        SpookyHash state;
+        uint64 hash1, hash2;
+
+        state.Init(0, 0);
+        for (size_t offset = 0; offset < buffer.size(); offset += 4096) {
+            state.Update(buffer.data() + offset, 4096);
+        }
+        state.Final(&hash1, &hash2);
+        sink = sink + hash1;
+    }, allocations);
+    report("spooky-stream-4k", impl, seconds, buffer.size(), 0, 0);
+}
+
+
+int main(int argc, const char *argv[])
+{
+    CmdOptionParser options(argc, argv);
+
+    if (options.cmdOptionExists("-h")) {
+        std::string cmd(argv[0]);
+
+        std::cout << "Usage: "
+                  << cmd.substr(cmd.rfind("/") + 1)
+                  << " [-r <rows>] [-d <directory>]\n"
+                  << "    -r    rows in each generated file (20000)\n"
+                  << "    -d    where to write the generated files (/tmp)\n";
+        return 1;
+    }
+
+    int rows = 20000;
+    std::string directory{"/tmp"};
+
+    if (options.cmdOptionExists("-r")) {
+        rows = std::stoi(options.getCmdOption("-r"));
+    }
+    if (options.cmdOptionExists("-d")) {
+        directory = options.getCmdOption("-d");
+    }
+
+    // a wrong hash is worse than a slow one
+    if (!SpookyHash::Verify()) {
+        std::cerr << "SpookyHash ("
+                  << SpookyHash::Name(SpookyHash::Best())
+                  << ") does not give its known answers!\n";
+        return 1;
+    }
+
+    // CSVFile tells us when it is destroyed, which we do not want mixed
+    // into the results
+    std::cerr.setstate(std::ios::failbit);
+
+    header();
+
+    for (const Shape &shape : shapes) {
+        std::string path = directory + "/csv_bench_" + shape.name + ".tsv";
+        size_t bytes = generate(shape, rows, path);
+
+        benchLoad(shape, path, bytes);
+#ifdef HAVE_ZLIB
+        benchCompressed(shape, path, bytes);
+#endif
+        benchAccess(shape, path);
+
+        std::remove(path.c_str());
+    }
+
+    benchSpooky();
+
+    return 0;
+}
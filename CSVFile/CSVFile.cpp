@@ -16,6 +16,7 @@
 
 #include "CmdOptionParser.hpp"
 #include "CSVFile.h"
+#include "CSVWriter.h"
 
 
 int main(int argc, const char *argv[])
@@ -31,17 +32,76 @@ int main(int argc, const char *argv[])
         std::cout << "file not specified!\n"
                   << "Usage: "
                   << cmd.substr(cmd.rfind("/") + 1)
-                  << " -f <filename>\n";
+                  << " -f <filename> [-m] [-a] [-c | -k | -l | -L] [-t <threads>]"
+                  << " [-s <snapshot>] [-o <output>] [-p <columns>] [-q]\n"
+                  << "    -m    memory map the file instead of reading it\n"
+                  << "    -a    allocate the rows from an arena\n"
+                  << "    -c    store the file by column instead of by row\n"
+                  << "    -k    store compact cells with pooled strings\n"
+                  << "    -l    only find the fields, typing them when read\n"
+                  << "    -L    the same, keeping each column once typed\n"
+                  << "    -t    parse with this many threads "
+                  << "(0 for one per core)\n"
+                  << "    -s    load from this snapshot if it is up to date,"
+                  << " else write it\n"
+                  << "    -o    write the file back out as tab separated"
+                  << " values\n"
+                  << "    -p    only load these columns, such as 0,1,158\n"
+                  << "    -q    the file is comma separated, with quoted"
+                  << " fields\n";
 
         return 1;
     }
 
+    CSVOptions csvOptions{};
+    csvOptions.mapped = options.cmdOptionExists("-m");
+    csvOptions.arena = options.cmdOptionExists("-a");
+
+    if (options.cmdOptionExists("-c")) {
+        csvOptions.storage = CSVStorage::Columns;
+    }
+    else if (options.cmdOptionExists("-k")) {
+        csvOptions.storage = CSVStorage::Compact;
+    }
+    else if (options.cmdOptionExists("-l") || options.cmdOptionExists("-L")) {
+        csvOptions.storage = CSVStorage::Lazy;
+        csvOptions.memoize = options.cmdOptionExists("-L");
+    }
+
+    if (options.cmdOptionExists("-t")) {
+        csvOptions.threads = std::stoi(options.getCmdOption("-t"));
+    }
+
+    csvOptions.snapshot = options.getCmdOption("-s");
+
+    if (options.cmdOptionExists("-q")) {
+        csvOptions.dialect = CSVDialect{',', true};
+    }
+
+    if (options.cmdOptionExists("-p")) {
+        std::vector<int> columns{};
+        std::istringstream list{options.getCmdOption("-p")};
+
+        for (std::string column; std::getline(list, column, ',');) {
+            columns.push_back(std::stoi(column));
+        }
+        csvOptions.columns = CSVProjection{columns};
+    }
+
     std::cout << "opening CSVFile: " << filePath << "\n";
     try {
-        CSVFile csvFile{filePath};
+        CSVFile csvFile{filePath, csvOptions};
 
         std::cout << csvFile << "\n";  // check that we can print it out
 
+        const std::string &outputPath = options.getCmdOption("-o");
+        if (!outputPath.empty()) {
+            CSVWriter writer{outputPath};
+
+            writer.writeFile(csvFile);
+            writer.close();
+        }
+
         // normal index into the rows
         std::cout << "\nRow 10: " << csvFile.getRow(10) << "\n";
 
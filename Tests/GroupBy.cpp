@@ -0,0 +1,164 @@
+//============================================================================
+// Name        : GroupBy.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Checks that CSVGroupBy finds the same groups, in the same
+//               order, on several threads as on one.
+//============================================================================
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CSVFile.h"
+#include "CSVGroupBy.h"
+
+
+static const char *sc_path = "group_by_test.tsv";
+
+// Checks groups against the ones a single thread found.
+static int compare(const std::string &what, const CSVGroupBy &expected,
+                   const CSVGroupBy &got, size_t keys, size_t values)
+{
+    if (got.size() != expected.size()) {
+        std::cerr << "FAIL: " << what << " has " << got.size()
+                  << " groups, not " << expected.size() << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+
+    for (int group = 0; group < expected.size(); ++group) {
+        bool same = got.firstRow(group) == expected.firstRow(group) &&
+                    got.rows(group) == expected.rows(group);
+
+        for (size_t key = 0; same && key < keys; ++key) {
+            same = got.key(group, key) == expected.key(group, key);
+        }
+
+        // the values are whole numbers, so their sums are exact in any
+        // order
+        for (size_t value = 0; same && value < values; ++value) {
+            const CSVStats &gotStats = got.stats(group, value);
+            const CSVStats &expectedStats = expected.stats(group, value);
+
+            same = gotStats.count() == expectedStats.count() &&
+                   gotStats.sum() == expectedStats.sum() &&
+                   (gotStats.count() == 0 ||
+                    (gotStats.min() == expectedStats.min() &&
+                     gotStats.max() == expectedStats.max()));
+        }
+
+        if (!same) {
+            std::cerr << "FAIL: " << what << " group " << group
+                      << " differs" << std::endl;
+            ++failures;
+        }
+        else if (group > 0 && got.firstRow(group) <= got.firstRow(group - 1))
+        {
+            std::cerr << "FAIL: " << what << " group " << group
+                      << " is out of order" << std::endl;
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+int main() {
+    // Keys that are strings and numbers, that first appear in every part
+    // of the file, and rows too short to have the second key or the value.
+    {
+        std::ofstream out{sc_path};
+
+        for (int row = 0; row < 3000; ++row) {
+            int key = (row * 7919) % (50 + row / 10);
+
+            if (key % 3 == 0) {
+                out << "k" << key;
+            }
+            else {
+                out << key;
+            }
+
+            if (row % 11 == 0) {
+                out << "\n";
+                continue;
+            }
+            out << "\t" << (row % 4 == 0 ? "a" : "b");
+
+            if (row % 13 == 0) {
+                out << "\n";
+                continue;
+            }
+            out << "\t" << (row % 9 == 0 ? std::string{"text"}
+                                         : std::to_string(row % 100 - 30))
+                << "\n";
+        }
+    }
+
+    struct Grouping
+    {
+        const char *name;
+        std::vector<int> keys;
+        std::vector<int> values;
+        CSVStringPolicy policy;
+    };
+
+    const std::vector<Grouping> groupings{
+        {"one key", {0}, {2}, CSVStringPolicy::Skip},
+        {"two keys", {0, 1}, {2, 0}, CSVStringPolicy::Zero},
+        {"no values", {1, 0}, {}, CSVStringPolicy::Skip},
+    };
+
+    int failures = 0;
+
+    for (CSVStorage storage : {CSVStorage::Rows, CSVStorage::Columns,
+                               CSVStorage::Compact}) {
+        CSVOptions options{};
+        options.storage = storage;
+
+        CSVFile csvFile{sc_path, options};
+
+        for (const Grouping &grouping : groupings) {
+            CSVGroupBy expected{csvFile, grouping.keys, grouping.values,
+                                grouping.policy, 1};
+
+            // a thread for every few rows, and more threads than rows
+            for (int threads : {2, 3, 8, 5000}) {
+                std::string what = std::string{grouping.name} + " on " +
+                                   std::to_string(threads) + " threads";
+                CSVGroupBy groups{csvFile, grouping.keys, grouping.values,
+                                  grouping.policy, threads, 1};
+
+                failures += compare(what, expected, groups,
+                                    grouping.keys.size(),
+                                    grouping.values.size());
+
+                for (int group = 0; group < groups.size(); ++group) {
+                    std::vector<CellView> key{};
+
+                    for (size_t i = 0; i < grouping.keys.size(); ++i) {
+                        key.push_back(groups.key(group, i));
+                    }
+                    if (groups.findGroup(key) != group) {
+                        std::cerr << "FAIL: " << what
+                                  << " cannot find group " << group
+                                  << std::endl;
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+
+    std::remove(sc_path);
+
+    std::cout << groupings.size() << " groupings, " << failures
+              << " failures" << std::endl;
+
+    return (failures == 0) ? 0 : 1;
+}
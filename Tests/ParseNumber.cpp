@@ -0,0 +1,102 @@
+//============================================================================
+// Name        : ParseNumber.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Checks that CSVRow::parseNumber() reads fields the way
+//               reading a double from a std::istringstream does.
+//============================================================================
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CSVFile.h"
+
+
+// how fields were told apart before parseNumber()
+static bool streamNumber(const std::string &field, double &number) {
+    std::istringstream ssField{field};
+
+    ssField >> number;
+
+    return !ssField.fail();
+}
+
+static bool sameNumber(double a, double b) {
+    // compare the bits, so that -0.0 and 0.0 differ
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+int main() {
+    const std::vector<std::string> fields{
+        // integers
+        "0", "7", "-7", "42", "1234567890", "-0", "007",
+        "9007199254740993", "123456789012345678901234567890",
+
+        // decimals
+        "1.5", "-1.5", ".5", "-.5", "5.", "0.1", "3.14159265358979323846",
+        "1.7976931348623157", "2.2250738585072014e-308",
+
+        // exponents
+        "1e5", "1E5", "1e+5", "1e-5", "-2.5e-3", "1.5E+300", ".5e1",
+        "5.e1", "1e0", "1e", "1e+", "1e-", "1ex", "1.5e", "e5", ".e5",
+
+        // white space around the number
+        " 1", "  -3.5", "\t2", "\n4", "\r\n5", "1 ", "1.5  ", " 1 ", "\t",
+        " ", "1 2",
+
+        // signs
+        "+1", "+1.5", "+.5", "+", "-", "+-1", "-+1", "--1", "++1", "+e5",
+
+        // infinities and NaN, which the stream does not read
+        "inf", "-inf", "+inf", "INF", "infinity", "nan", "NaN", "-nan",
+        "nan(1)",
+
+        // hex, which the stream reads as its leading 0
+        "0x1A", "0X1a", "-0x10", "0x", "0x1p3", "x1",
+
+        // out of range
+        "1e309", "-1e309", "1e400", "1e99999", "1e-400", "-1e-400",
+        "1e-320", "4.9e-324", "2e-324",
+
+        // partly numeric
+        "1.5abc", "12px", "3.0.1", "1,000", "1_000", "5%", "$5", "1/2",
+        "1e5e5", "-5-", "0.5.", "1..2",
+
+        // not numbers at all
+        "", "abc", "USD", "bbl", ".", "..", "-.", "+.", "e", "E",
+    };
+
+    int failures = 0;
+
+    for (const std::string &field : fields) {
+        double expected{}, got{};
+        bool streamed = streamNumber(field, expected);
+        bool parsed = CSVRow::parseNumber(field, got);
+
+        if (streamed != parsed) {
+            std::cerr << "FAIL: \"" << field << "\" is "
+                      << (streamed ? "a number" : "a string")
+                      << " to the stream, but "
+                      << (parsed ? "a number" : "a string")
+                      << " to parseNumber()" << std::endl;
+            ++failures;
+        }
+        else if (streamed && !sameNumber(expected, got)) {
+            std::cerr.precision(17);
+            std::cerr << "FAIL: \"" << field << "\" is " << expected
+                      << " to the stream, but " << got
+                      << " to parseNumber()" << std::endl;
+            ++failures;
+        }
+    }
+
+    std::cout << fields.size() << " fields, " << failures << " failures"
+              << std::endl;
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+//============================================================================
+// Name        : Quoting.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Checks that quoted CSV fields read the same, and as RFC 4180
+//               has them, whichever way the file is loaded.
+//============================================================================
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CSVFile.h"
+#include "CSVReader.h"
+
+
+using namespace std::string_literals;
+
+using Rows = std::vector<std::vector<Cell>>;
+
+static const char *sc_path = "quoting_test.csv";
+
+static const CSVDialect sc_csv{',', true};
+
+static std::string show(CellView cell) {
+    if (std::holds_alternative<double>(cell)) {
+        return std::to_string(std::get<double>(cell));
+    }
+
+    std::string out{"\""};
+
+    for (char c : std::get<std::string_view>(cell)) {
+        out += (c == '\n') ? "\\n" : (c == '\r') ? "\\r" : std::string(1, c);
+    }
+
+    return out + "\"";
+}
+
+// Checks the row one way of loading gave against the one we expect.
+static int checkRow(const std::string &what, int row,
+                    const std::vector<CellView> &got,
+                    const std::vector<Cell> &expected)
+{
+    bool same = got.size() == expected.size();
+
+    for (size_t i = 0; same && i < got.size(); ++i) {
+        same = got[i] == toCellView(expected[i]);
+    }
+
+    if (!same) {
+        std::cerr << "FAIL: " << what << " row " << row << " is";
+        for (CellView cell : got) {
+            std::cerr << " " << show(cell);
+        }
+        std::cerr << ", not";
+        for (const Cell &cell : expected) {
+            std::cerr << " " << show(toCellView(cell));
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Loads sc_path every way we have and checks each gives expected.
+static int checkLoads(const std::string &name, const Rows &expected) {
+    struct Load
+    {
+        const char *name;
+        CSVOptions options;
+    };
+
+    std::vector<Load> loads(6);
+    int failures = 0;
+
+    loads[0].name = "stream";
+    loads[1].name = "mapped";
+    loads[1].options.mapped = true;
+    loads[2].name = "arena";
+    loads[2].options.arena = true;
+    loads[3].name = "threads";
+    loads[3].options.threads = 3;
+    loads[4].name = "columns";
+    loads[4].options.storage = CSVStorage::Columns;
+    loads[5].name = "compact";
+    loads[5].options.storage = CSVStorage::Compact;
+
+    for (Load &load : loads) {
+        std::string what = name + " (" + load.name + ")";
+
+        load.options.dialect = sc_csv;
+
+        CSVFile csvFile{sc_path, load.options};
+
+        if (csvFile.size() != static_cast<int>(expected.size())) {
+            std::cerr << "FAIL: " << what << " has " << csvFile.size()
+                      << " rows, not " << expected.size() << std::endl;
+            ++failures;
+            continue;
+        }
+
+        for (int row = 0; row < csvFile.size(); ++row) {
+            CSVRowView rowView = csvFile.getRowView(row);
+            std::vector<CellView> cells{};
+
+            for (int column = 0; column < rowView.size(); ++column) {
+                cells.push_back(rowView[column]);
+            }
+            failures += checkRow(what, row, cells, expected[row]);
+        }
+    }
+
+    // and a row at a time, through a buffer smaller than a block
+    CSVReader reader{sc_path, 4096, sc_csv};
+    CSVRow csvRow{};
+    size_t row = 0;
+
+    for (; reader.readRow(csvRow); ++row) {
+        std::vector<CellView> cells{};
+
+        for (int column = 0; column < csvRow.size(); ++column) {
+            cells.push_back(toCellView(csvRow[column]));
+        }
+        if (row < expected.size()) {
+            failures += checkRow(name + " (reader)", row, cells,
+                                 expected[row]);
+        }
+    }
+
+    if (row != expected.size()) {
+        std::cerr << "FAIL: " << name << " (reader) has " << row
+                  << " rows, not " << expected.size() << std::endl;
+        ++failures;
+    }
+
+    return failures;
+}
+
+static void writeFile(const std::string &text) {
+    std::ofstream out{sc_path, std::ios::binary | std::ios::trunc};
+
+    out << text;
+}
+
+// Appends short rows to text, and to expected, until it is length bytes.
+static void padTo(std::string &text, Rows &expected, size_t length) {
+    while (text.size() + 16 < length) {
+        std::string field = "row" + std::to_string(expected.size());
+
+        text += field + ",1\n";
+        expected.push_back({std::string{field}, 1.0});
+    }
+
+    std::string field(length - text.size() - 1, 'x');
+
+    text += field + "\n";
+    expected.push_back({field});
+}
+
+int main() {
+    struct Case
+    {
+        const char *name;
+        std::string text;
+        Rows expected;
+    };
+
+    const std::vector<Case> cases{
+        {"doubled quotes", "\"a\"\"b\",\"\"\"\"\n\"\",x\n",
+         {{"a\"b"s, "\""s}, {""s, "x"s}}},
+        {"quote inside a field", "a 5\" pipe,x\"y\"\nb\",\"y,z\"\n",
+         {{"a 5\" pipe"s, "x\"y\""s}, {"b\""s, "y,z"s}}},
+        {"quoted separators", "\"a,b\",\"c\nd\"\ne\n",
+         {{"a,b"s, "c\nd"s}, {"e"s}}},
+        {"CRLF outside quotes", "a,b\r\nc,\"d\"\r\n",
+         {{"a"s, "b"s}, {"c"s, "d"s}}},
+        {"CRLF inside quotes", "\"a\r\nb\",c\r\n\"\r\n\"\r\n",
+         {{"a\r\nb"s, "c"s}, {"\r\n"s}}},
+        {"trailing delimiters", "a,\r\n,\n\"\",\n",
+         {{"a"s, ""s}, {""s, ""s}, {""s, ""s}}},
+        {"quoted numbers", "\"1.5\",2,\" 3\"\n", {{1.5, 2.0, 3.0}}},
+        {"no final newline", "a,\"b\nc\"", {{"a"s, "b\nc"s}}},
+    };
+
+    int failures = 0;
+
+    for (const Case &check : cases) {
+        writeFile(check.text);
+        failures += checkLoads(check.name, check.expected);
+    }
+
+    // Fields that a chunk of the file ends inside of: a quoted newline, a
+    // doubled quote, and a CRLF, each split by the boundary, and a quoted
+    // delimiter just after one.
+    const size_t chunk = 1 << 20;   // ReadAheadFile's blocks
+    std::string text{};
+    Rows expected{};
+
+    padTo(text, expected, chunk - 3);
+    text += "\"a\nb\",c\n";
+    expected.push_back({"a\nb"s, "c"s});
+
+    padTo(text, expected, 2 * chunk - 3);
+    text += "\"x\"\"y\"\n";
+    expected.push_back({"x\"y"s});
+
+    padTo(text, expected, 3 * chunk - 4);
+    text += "d,e\r\n";
+    expected.push_back({"d"s, "e"s});
+
+    padTo(text, expected, 4 * chunk - 1);
+    text += "\",\",f\n";
+    expected.push_back({","s, "f"s});
+
+    // and a quoted field longer than a chunk
+    std::string longField(chunk + 100, ',');
+
+    longField[chunk / 2] = '\n';
+    text += "g,\"" + longField + "\"\n";
+    expected.push_back({"g"s, longField});
+
+    writeFile(text);
+    failures += checkLoads("across chunks", expected);
+
+    std::remove(sc_path);
+
+    std::cout << cases.size() + 1 << " files, " << failures << " failures"
+              << std::endl;
+
+    return (failures == 0) ? 0 : 1;
+}
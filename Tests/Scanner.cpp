@@ -0,0 +1,203 @@
+//============================================================================
+// Name        : Scanner.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Checks that every CSVScanner implementation the CPU can
+//               run finds the same fields, and the ones we expect.
+//============================================================================
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "CSVScanner.h"
+
+
+using Rows = std::vector<std::vector<std::string>>;
+
+// the fields forEachRow() finds in text
+static Rows split(const CSVScanner &scanner, const std::string &text) {
+    Rows rows{};
+
+    scanner.forEachRow(text,
+        [&](std::string_view line, const std::vector<uint32_t> &ends) {
+            std::vector<std::string> fields{};
+            size_t start = 0;
+
+            for (uint32_t end : ends) {
+                fields.emplace_back(line.substr(start, end - start));
+                start = end + 1;
+            }
+            rows.push_back(fields);
+        });
+
+    return rows;
+}
+
+static std::string show(const Rows &rows) {
+    std::string out{};
+
+    for (const std::vector<std::string> &fields : rows) {
+        out += "[";
+        for (size_t i = 0; i < fields.size(); ++i) {
+            out += (i > 0) ? "|" : "";
+            out += fields[i];
+        }
+        out += "]";
+    }
+
+    return out;
+}
+
+struct Case
+{
+    std::string name;
+    std::string text;
+    char delimiter;
+    bool quoting;
+    Rows expected;
+};
+
+static std::vector<Case> cases() {
+    std::vector<Case> result{
+        {"plain", "a\tb\n", '\t', false, {{"a", "b"}}},
+        {"trailing delimiter", "a\tb\t\n", '\t', false, {{"a", "b"}}},
+        {"only a delimiter", "\t\n", '\t', false, {{""}}},
+        {"empty lines", "a\n\n\nb\n\n", '\t', false, {{"a"}, {"b"}}},
+        {"no final newline", "a\tb\nc\td", '\t', false,
+         {{"a", "b"}, {"c", "d"}}},
+        {"carriage return", "a\tb\r\n", '\t', false, {{"a", "b\r"}}},
+        {"high bytes", "\xe9\t\xff\n\x80", '\t', false,
+         {{"\xe9", "\xff"}, {"\x80"}}},
+
+        {"quoted separators", "\"a,b\",c\n\"d\ne\",f\n", ',', true,
+         {{"\"a,b\"", "c"}, {"\"d\ne\"", "f"}}},
+        {"doubled quotes", "\"a\"\"b,\",c\n", ',', true,
+         {{"\"a\"\"b,\"", "c"}}},
+        {"quote inside a field", "5\" pipe,x\n6\",\"y,z\"\n", ',', true,
+         {{"5\" pipe", "x"}, {"6\"", "\"y,z\""}}},
+        {"quoted trailing delimiter", "a,b,\n,\n", ',', true,
+         {{"a", "b", ""}, {"", ""}}},
+        {"unterminated quote", "a,\"b,c\nd", ',', true,
+         {{"a", "\"b,c\nd"}}},
+    };
+
+    // a delimiter, a quote and a newline on each side of the 16, 32 and 64
+    // byte blocks the vector scans take
+    for (size_t at : {0, 1, 14, 15, 16, 17, 30, 31, 32, 33, 62, 63, 64, 65}) {
+        std::string pad(at, 'x');
+
+        result.push_back({"delimiter at " + std::to_string(at),
+                          pad + "\ty\n", '\t', false, {{pad, "y"}}});
+        result.push_back({"newline at " + std::to_string(at),
+                          pad + "\nyz", '\t', false,
+                          at > 0 ? Rows{{pad}, {"yz"}} : Rows{{"yz"}}});
+        result.push_back({"last byte at " + std::to_string(at),
+                          pad + "\tq", '\t', false, {{pad, "q"}}});
+
+        if (at > 0) {
+            std::string field = "\"" + std::string(at - 1, ',') + "\n\"";
+
+            result.push_back({"quoted field to " + std::to_string(at),
+                              field + ",z\n", ',', true, {{field, "z"}}});
+        }
+    }
+
+    return result;
+}
+
+// length random characters from alphabet
+static std::string randomText(std::mt19937 &random,
+                              const std::string &alphabet, size_t length)
+{
+    std::string text(length, ' ');
+
+    for (char &c : text) {
+        c = alphabet[random() % alphabet.size()];
+    }
+
+    return text;
+}
+
+int main() {
+    std::vector<CSVScanner::Impl> impls{};
+    int failures = 0;
+
+    // each implementation assumes the ones before it
+    for (CSVScanner::Impl impl : {CSVScanner::Impl::Scalar,
+                                  CSVScanner::Impl::SSE2,
+                                  CSVScanner::Impl::AVX2}) {
+        if (impl <= CSVScanner::best()) {
+            impls.push_back(impl);
+        }
+    }
+
+    for (const Case &check : cases()) {
+        for (CSVScanner::Impl impl : impls) {
+            CSVScanner scanner{check.delimiter, check.quoting, impl};
+            Rows rows = split(scanner, check.text);
+
+            if (rows != check.expected) {
+                std::cerr << "FAIL: " << check.name << " with "
+                          << CSVScanner::name(impl) << " gives "
+                          << show(rows) << ", not " << show(check.expected)
+                          << std::endl;
+                ++failures;
+            }
+        }
+    }
+
+    // random text, with the scalar scan as the reference, in pieces small
+    // and large enough to cross forEachRow's blocks
+    std::mt19937 random{2024};
+    int texts = 0;
+
+    for (bool quoting : {false, true}) {
+        std::string alphabet = quoting ? "ab,\"\"\n\r 1x" : "ab\t\t\n\r 1\xe9";
+        char delimiter = quoting ? ',' : '\t';
+
+        for (size_t length : {100, 1000, 5000, 3000000}) {
+            int count = (length > 10000) ? 1 : 500;
+
+            for (int i = 0; i < count; ++i, ++texts) {
+                std::string text = randomText(random, alphabet,
+                    length / 2 + random() % (length / 2));
+                Rows expected = split(CSVScanner{delimiter, quoting,
+                                                 CSVScanner::Impl::Scalar},
+                                      text);
+                std::vector<uint32_t> expectedScan{};
+
+                CSVScanner{delimiter, quoting, CSVScanner::Impl::Scalar}
+                    .scan(text.data(), text.size(), expectedScan);
+
+                for (CSVScanner::Impl impl : impls) {
+                    CSVScanner scanner{delimiter, quoting, impl};
+                    std::vector<uint32_t> scanned{};
+
+                    scanner.scan(text.data(), text.size(), scanned);
+
+                    if (scanned != expectedScan ||
+                        split(scanner, text) != expected)
+                    {
+                        std::cerr << "FAIL: " << CSVScanner::name(impl)
+                                  << (quoting ? " quoting" : "")
+                                  << " differs from scalar on random text "
+                                  << texts << std::endl;
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+
+    std::cout << cases().size() << " cases and " << texts
+              << " random texts on";
+    for (CSVScanner::Impl impl : impls) {
+        std::cout << " " << CSVScanner::name(impl);
+    }
+    std::cout << ", " << failures << " failures" << std::endl;
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+//============================================================================
+// Name        : Snapshot.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Checks that a snapshot that is truncated, corrupt or older
+//               than its source is refused, and the source parsed again.
+//============================================================================
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "CSVFile.h"
+#include "CSVSnapshot.h"
+
+
+static const char *sc_sourcePath = "snapshot_source.tsv";
+static const char *sc_snapshotPath = "snapshot_source.snap";
+
+// where the header's fields are, as CSVSnapshot.h lays it out
+static const size_t sc_fileSizeAt = 16;
+static const size_t sc_rowsAt = 48;
+static const size_t sc_stringsAt = 64;
+static const size_t sc_headerSize = 72;
+
+static std::string readFile(const char *path) {
+    std::ifstream in{path, std::ios::binary};
+
+    return std::string{std::istreambuf_iterator<char>{in}, {}};
+}
+
+static void writeFile(const char *path, const std::string &data) {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+
+    out << data;
+}
+
+template <typename Value>
+static Value get(const std::string &data, size_t offset) {
+    Value value;
+
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+template <typename Value>
+static void set(std::string &data, size_t offset, Value value) {
+    std::memcpy(&data[offset], &value, sizeof(value));
+}
+
+static size_t align(size_t offset) {
+    return (offset + 7) & ~size_t{7};
+}
+
+// where the string ends start, after the row sizes, counts and columns
+static size_t stringEndsAt(const std::string &data) {
+    size_t rows = get<uint32_t>(data, sc_rowsAt);
+    size_t columns = get<uint32_t>(data, sc_rowsAt + 8);
+    size_t offset = align(sc_headerSize + 4 * rows);
+
+    offset = align(offset + 8 * columns);
+    return offset + 8 * columns * ((rows + 63) / 64 + rows);
+}
+
+// Whether csvFile holds the same cells as the source parsed afresh.
+static bool sameCells(const CSVFile &csvFile) {
+    CSVFile parsed{sc_sourcePath};
+
+    if (csvFile.size() != parsed.size()) {
+        return false;
+    }
+
+    for (int row = 0; row < parsed.size(); ++row) {
+        CSVRowView expected = parsed.getRowView(row);
+        CSVRowView got = csvFile.getRowView(row);
+
+        if (got.size() != expected.size()) {
+            return false;
+        }
+        for (int column = 0; column < expected.size(); ++column) {
+            if (got[column] != expected[column]) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Loads the source with the snapshot, and checks it came from storage and
+// holds the source's cells.
+static int checkLoad(const std::string &what, CSVStorage storage) {
+    CSVOptions options{};
+    options.snapshot = sc_snapshotPath;
+
+    try {
+        CSVFile csvFile{sc_sourcePath, options};
+
+        if (csvFile.storage() != storage) {
+            std::cerr << "FAIL: " << what << " was "
+                      << (storage == CSVStorage::Snapshot ? "parsed"
+                                                          : "mapped")
+                      << std::endl;
+            return 1;
+        }
+        else if (!sameCells(csvFile)) {
+            std::cerr << "FAIL: " << what << " has the wrong cells"
+                      << std::endl;
+            return 1;
+        }
+    }
+    catch (const Exception &exc) {
+        std::cerr << "FAIL: " << what << " threw " << exc.getError()
+                  << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    {
+        std::ofstream out{sc_sourcePath};
+
+        for (int row = 0; row < 500; ++row) {
+            out << row << "\tname" << row % 7 << "\t" << row * 0.25;
+            if (row % 3 == 0) {
+                out << "\tUSD";
+            }
+            out << "\n";
+        }
+    }
+
+    std::remove(sc_snapshotPath);
+
+    int failures = 0;
+
+    // the first load writes the snapshot, and the next one maps it
+    failures += checkLoad("first load", CSVStorage::Rows);
+    failures += checkLoad("load with a snapshot", CSVStorage::Snapshot);
+
+    const std::string good = readFile(sc_snapshotPath);
+    const size_t stringEnds = stringEndsAt(good);
+    const uint64_t strings = get<uint64_t>(good, sc_stringsAt);
+
+    // Each breaks the snapshot in its own way.  The snapshot must be
+    // refused and the source parsed, which writes a good snapshot again.
+    struct Corruption
+    {
+        const char *name;
+        std::function<void(std::string &)> corrupt;
+    };
+
+    const std::vector<Corruption> corruptions{
+        {"a truncated snapshot", [&](std::string &data) {
+            data.resize(data.size() - 5);
+        }},
+        {"a truncated snapshot that says it is not", [&](std::string &data) {
+            data.resize(data.size() - 16);
+            set<uint64_t>(data, sc_fileSizeAt, data.size());
+        }},
+        {"only a header", [&](std::string &data) {
+            data.resize(sc_headerSize);
+            set<uint64_t>(data, sc_fileSizeAt, data.size());
+        }},
+        {"a bad magic number", [&](std::string &data) {
+            data[0] = 'X';
+        }},
+        {"too many rows", [&](std::string &data) {
+            set<uint32_t>(data, sc_rowsAt, 0xffffffffu);
+        }},
+        {"rows that do not fit", [&](std::string &data) {
+            set<uint32_t>(data, sc_rowsAt, 1000000);
+        }},
+        {"strings that overflow", [&](std::string &data) {
+            set<uint64_t>(data, sc_stringsAt, UINT64_MAX / 4);
+        }},
+        {"a row wider than the columns", [&](std::string &data) {
+            set<uint32_t>(data, sc_headerSize, 1000);
+        }},
+        {"string ends out of order", [&](std::string &data) {
+            set<uint64_t>(data, stringEnds, 1000000);
+        }},
+        {"string ends past the characters", [&](std::string &data) {
+            set<uint64_t>(data, stringEnds + 8 * (strings - 1),
+                          get<uint64_t>(data, stringEnds + 8 * (strings - 1))
+                          + 1);
+        }},
+    };
+
+    for (const Corruption &corruption : corruptions) {
+        std::string data = good;
+
+        corruption.corrupt(data);
+        writeFile(sc_snapshotPath, data);
+
+        failures += checkLoad(corruption.name, CSVStorage::Rows);
+        failures += checkLoad(std::string{"the snapshot rewritten after "} +
+                              corruption.name, CSVStorage::Snapshot);
+    }
+
+    // a source that changed since, first in place and then in size
+    std::string source = readFile(sc_sourcePath);
+
+    source[source.size() / 2] = (source[source.size() / 2] == '1') ? '2'
+                                                                   : '1';
+    writeFile(sc_sourcePath, source);
+    failures += checkLoad("a source changed in place", CSVStorage::Rows);
+    failures += checkLoad("the snapshot of the changed source",
+                          CSVStorage::Snapshot);
+
+    writeFile(sc_sourcePath, source + "1\tmore\n");
+    failures += checkLoad("a source that grew", CSVStorage::Rows);
+    failures += checkLoad("the snapshot of the grown source",
+                          CSVStorage::Snapshot);
+
+    std::remove(sc_sourcePath);
+    std::remove(sc_snapshotPath);
+
+    std::cout << corruptions.size() << " corruptions, " << failures
+              << " failures" << std::endl;
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+//============================================================================
+// Name        : SpookyHash.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Checks that every way we have of running SpookyHash gives
+//               the hashes of the original SpookyV2 code.
+//============================================================================
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "SpookyV2.h"
+
+
+//
+// The known answers, from the original SpookyV2 Hash128 and Hash64 of the
+// messages below, each list of hashes folded into two words by fold().
+// Update must give Hash128's.  The tree's are the original Hash128 of
+// each chunk and then of the chunks' hashes, cut and seeded as
+// sc_treeVersion 1 says.
+//
+static const uint64 sc_hash128[2] = {
+    0x00c6d37cf0d4a2ffULL, 0x8e8c7eea437335ccULL};
+static const uint64 sc_hash64[2] = {
+    0xda993d652aa0da21ULL, 0xea2b4ee64d1a48a9ULL};
+static const uint64 sc_tree[2] = {
+    0x2534c3990face761ULL, 0x89e7b071b42ed3f8ULL};
+
+// Lengths around the short message limit and the block and buffer sizes,
+// and some long enough for many blocks.
+static std::vector<size_t> lengths() {
+    std::vector<size_t> result{};
+
+    for (size_t length = 0; length <= 300; ++length) {
+        result.push_back(length);
+    }
+    for (size_t length : {1000, 4095, 4096, 4097, 65537}) {
+        result.push_back(length);
+    }
+
+    return result;
+}
+
+// Folds a list of hashes into two words, without SpookyHash itself.
+static void fold(const std::vector<uint64> &hashes, uint64 folded[2]) {
+    folded[0] = folded[1] = 0;
+
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        uint64 &word = folded[i % 2];
+
+        word = ((word << 5) | (word >> 59)) ^ hashes[i];
+        word *= 0x9e3779b97f4a7c15ULL;
+    }
+}
+
+static int check(const std::string &what, const std::vector<uint64> &hashes,
+                 const uint64 expected[2])
+{
+    uint64 folded[2];
+
+    fold(hashes, folded);
+
+    if (folded[0] != expected[0] || folded[1] != expected[1]) {
+        std::cerr << "FAIL: " << what << " gives " << std::hex
+                  << folded[0] << " " << folded[1] << ", not "
+                  << expected[0] << " " << expected[1] << std::dec
+                  << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    const size_t treeLength = 5 * SpookyHash::sc_treeChunkSize / 2 + 123;
+    const size_t offsets[] = {0, 5};
+    std::vector<uint8> buffer(treeLength + 8);
+    int failures = 0;
+
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = (uint8)(i*7 + (i >> 9));
+    }
+
+    if (!SpookyHash::Verify()) {
+        std::cerr << "FAIL: Verify()" << std::endl;
+        ++failures;
+    }
+
+    // Hash128 with each way of mixing blocks, and with the one it picks
+    const SpookyHash::Impl impls[] = {SpookyHash::Portable, SpookyHash::BMI2};
+
+    for (int pass = 0; pass < 3; ++pass) {
+        std::vector<uint64> hashes{};
+        std::string name = (pass < 2) ? SpookyHash::Name(impls[pass])
+                                      : "best";
+
+        if (pass < 2 && !SpookyHash::Supported(impls[pass])) {
+            std::cout << "Hash128 " << name << ": not supported here"
+                      << std::endl;
+            continue;
+        }
+
+        for (size_t offset : offsets) {
+            for (size_t length : lengths()) {
+                uint64 hash1 = length, hash2 = ~length;
+
+                if (pass < 2) {
+                    SpookyHash::Hash128(impls[pass], &buffer[offset], length,
+                                        &hash1, &hash2);
+                }
+                else {
+                    SpookyHash::Hash128(&buffer[offset], length,
+                                        &hash1, &hash2);
+                }
+                hashes.push_back(hash1);
+                hashes.push_back(hash2);
+            }
+        }
+        failures += check("Hash128 " + name, hashes, sc_hash128);
+    }
+
+    // Update with pieces that start part way into blocks and the buffer
+    {
+        const size_t pieces[] = {1, 7, 96, 191, 13};
+        std::vector<uint64> hashes{};
+
+        for (size_t offset : offsets) {
+            for (size_t length : lengths()) {
+                SpookyHash state;
+                uint64 hash1, hash2;
+                size_t done = 0;
+
+                state.Init(length, ~length);
+                for (size_t piece = 0; done < length; ++piece) {
+                    size_t size = std::min(pieces[piece % 5], length - done);
+
+                    state.Update(&buffer[offset + done], size);
+                    done += size;
+                }
+                state.Final(&hash1, &hash2);
+                hashes.push_back(hash1);
+                hashes.push_back(hash2);
+            }
+        }
+        failures += check("Update", hashes, sc_hash128);
+    }
+
+    // Hash64Batch, which must give Hash64 of each message
+    {
+        std::vector<const void *> messages{};
+        std::vector<size_t> sizes{};
+
+        for (size_t offset : offsets) {
+            for (size_t length : lengths()) {
+                messages.push_back(&buffer[offset]);
+                sizes.push_back(length);
+            }
+        }
+
+        std::vector<uint64> hashes(messages.size());
+
+        SpookyHash::Hash64Batch(&messages[0], &sizes[0], messages.size(), 99,
+                                &hashes[0]);
+        failures += check("Hash64Batch", hashes, sc_hash64);
+    }
+
+    // HashTree128 on one and several threads, which must agree
+    for (int threads : {1, 3}) {
+        std::vector<uint64> hashes{};
+
+        for (size_t length : {size_t(0), size_t(100),
+                              SpookyHash::sc_treeChunkSize, treeLength}) {
+            uint64 hash1 = 3, hash2 = 4;
+
+            SpookyHash::HashTree128(&buffer[0], length, &hash1, &hash2,
+                                    threads);
+            hashes.push_back(hash1);
+            hashes.push_back(hash2);
+        }
+        failures += check("HashTree128 on " + std::to_string(threads) +
+                          " threads", hashes, sc_tree);
+    }
+
+    std::cout << "SpookyHash (" << SpookyHash::Name(SpookyHash::Best())
+              << "), " << failures << " failures" << std::endl;
+
+    return (failures == 0) ? 0 : 1;
+}
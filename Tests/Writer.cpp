@@ -0,0 +1,204 @@
+//============================================================================
+// Name        : Writer.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Checks that what CSVWriter writes reads back as the same
+//               cells, and that it writes numbers the way a stream does.
+//============================================================================
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CSVFile.h"
+#include "CSVWriter.h"
+
+
+static const char *sc_sourcePath = "writer_source.csv";
+static const char *sc_outputPath = "writer_output.txt";
+
+static const CSVDialect sc_csv{',', true};
+
+static void writeFile(const char *path, const std::string &text) {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+
+    out << text;
+}
+
+// Checks that two files have the same rows and cells, comparing numbers
+// exactly.
+static int compare(const std::string &what, const CSVFile &expected,
+                   const CSVFile &got)
+{
+    int failures = 0;
+
+    if (got.size() != expected.size()) {
+        std::cerr << "FAIL: " << what << " has " << got.size()
+                  << " rows, not " << expected.size() << std::endl;
+        return 1;
+    }
+
+    for (int row = 0; row < expected.size(); ++row) {
+        CSVRowView expectedRow = expected.getRowView(row);
+        CSVRowView gotRow = got.getRowView(row);
+
+        if (gotRow.size() != expectedRow.size()) {
+            std::cerr << "FAIL: " << what << " row " << row << " has "
+                      << gotRow.size() << " fields, not "
+                      << expectedRow.size() << std::endl;
+            ++failures;
+            continue;
+        }
+
+        for (int column = 0; column < expectedRow.size(); ++column) {
+            if (gotRow[column] != expectedRow[column]) {
+                std::cerr << "FAIL: " << what << " row " << row
+                          << " column " << column << " differs" << std::endl;
+                ++failures;
+            }
+        }
+    }
+
+    return failures;
+}
+
+// Writes source in format, reads it back with dialect, and compares.
+static int roundTrip(const std::string &name, const CSVFile &source,
+                     CSVFormat format, const CSVDialect &dialect)
+{
+    {
+        CSVWriter writer{sc_outputPath, format};
+
+        writer.writeFile(source);
+        writer.close();
+    }
+
+    CSVOptions options{};
+    options.dialect = dialect;
+
+    CSVFile reread{sc_outputPath, options};
+
+    return compare(name, source, reread);
+}
+
+// Checks the Debug format writes numbers as the stream would with its
+// flags and precision.
+static int streamNumbers() {
+    const std::vector<double> numbers{
+        0.0, -0.0, 1.0, -1.5, 0.1, 1.0 / 3.0, 123456789.0, 1e-7, 1e21,
+        -2.5e-300, 1.7976931348623157e308, 65536.0, 100.0,
+        HUGE_VAL, -HUGE_VAL,
+    };
+    const std::vector<std::ios_base::fmtflags> flags{
+        std::ios_base::fmtflags{},
+        std::ios_base::fixed,
+        std::ios_base::scientific,
+        std::ios_base::fixed | std::ios_base::scientific,
+        std::ios_base::showpos,
+        std::ios_base::showpoint,
+        std::ios_base::uppercase | std::ios_base::scientific,
+        std::ios_base::showpos | std::ios_base::showpoint |
+            std::ios_base::fixed,
+    };
+    int failures = 0;
+
+    for (std::ios_base::fmtflags flag : flags) {
+        for (int precision : {0, 3, 6, 17}) {
+            std::ostringstream expected{};
+            std::ostringstream got{};
+
+            for (std::ostream *out : {&expected, &got}) {
+                out->flags(flag);
+                out->precision(precision);
+            }
+
+            for (double number : numbers) {
+                expected << number << ";";
+            }
+
+            {
+                CSVWriter writer{got};
+
+                for (double number : numbers) {
+                    writer.writeCell(CellView{number});
+                    writer.writeCell(CellView{std::string_view{";"}});
+                }
+            }
+
+            if (got.str() != expected.str()) {
+                std::cerr << "FAIL: with flags " << std::hex << flag
+                          << std::dec << " and precision " << precision
+                          << " we write \"" << got.str()
+                          << "\", not \"" << expected.str() << "\""
+                          << std::endl;
+                ++failures;
+            }
+        }
+    }
+
+    return failures;
+}
+
+int main() {
+    // Fields a writer can get wrong: numbers needing every digit, strings
+    // needing quotes, and empty fields everywhere in a row, including
+    // rows that are nothing else.
+    const std::string common =
+        "0.1,-0,1e300,2.2250738585072014e-308,123456789012,"
+        "0.30000000000000004\n"
+        "plain,a b,x\"y,'single',-\n"
+        ",middle,,\n"
+        "last,\n"
+        "\"\"\n"
+        ",\n"
+        "1,,2,,\n";
+
+    // strings only CSV can write
+    const std::string quoted =
+        "\"with, comma\",\"with \"\"quotes\"\"\",\"\"\"\"\n"
+        "\"new\nline\",\"tab\there\",\"\r\"\n"
+        "\" padded \",\"trailing,\",\n";
+
+    int failures = 0;
+
+    // TSV cannot escape delimiters or newlines, so it only gets the rows
+    // that have none in their strings
+    {
+        writeFile(sc_sourcePath, common);
+
+        CSVOptions options{};
+        options.dialect = sc_csv;
+
+        CSVFile source{sc_sourcePath, options};
+
+        failures += roundTrip("TSV", source, CSVFormat::TSV, CSVDialect{});
+        failures += roundTrip("CSV", source, CSVFormat::CSV, sc_csv);
+    }
+
+    {
+        writeFile(sc_sourcePath, common + quoted);
+
+        CSVOptions options{};
+        options.dialect = sc_csv;
+
+        CSVFile source{sc_sourcePath, options};
+
+        failures += roundTrip("CSV with quotes", source, CSVFormat::CSV,
+                              sc_csv);
+    }
+
+    failures += streamNumbers();
+
+    std::remove(sc_sourcePath);
+    std::remove(sc_outputPath);
+
+    std::cout << failures << " failures" << std::endl;
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+//============================================================================
+// Name        : CSVAggregate.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Summary statistics over the numbers in a column of a CSV
+//               file.
+//============================================================================
+
+#ifndef __CSVAGGREGATE_H__
+#define __CSVAGGREGATE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+
+
+// What to do with the non-empty string cells of a column we are reducing.
+// Empty strings and the cells missing from short rows are nulls, and are
+// always left out.
+enum class CSVStringPolicy
+{
+    Skip,   // leave them out, like nulls
+    Zero,   // count them as 0.0
+    Throw   // throw a TypeError
+};
+
+
+// The count, sum, extremes, mean and variance of a set of numbers.  Two
+// CSVStats can be merged, so we can reduce separate parts of a column on
+// separate threads and combine them after.
+//
+// The variance is kept as the sum of squared differences from the mean,
+// which unlike a sum of squares does not lose its precision to a large
+// mean.
+class CSVStats
+{
+private:
+    size_t m_count{0};
+    double m_sum{0.0};
+    double m_min{std::numeric_limits<double>::infinity()};
+    double m_max{-std::numeric_limits<double>::infinity()};
+    double m_squares{0.0};   // squared differences from the mean
+
+    void addBlock(const double *values, size_t count);
+public:
+    // Adds values[row] for each row from begin to end whose bit is set in
+    // numberBits, bit row % 64 of word row / 64.  The other values are not
+    // looked at, so they can be anything.
+    void addNumbers(const double *values, const uint64_t *numberBits,
+                    size_t begin, size_t end);
+
+    // Welford's update, for adding values one at a time
+    void add(double value) {
+        double difference = value - (m_count > 0 ? m_sum / m_count : 0.0);
+
+        ++m_count;
+        m_sum += value;
+        m_squares += difference * (value - m_sum / m_count);
+        m_min = value < m_min ? value : m_min;
+        m_max = value > m_max ? value : m_max;
+    }
+
+    // adds value as many times as we are told
+    void addRepeated(double value, size_t times);
+
+    void merge(const CSVStats &other);
+
+    // the number of values, not counting nulls or skipped strings
+    size_t count() const {
+        return m_count;
+    }
+
+    double sum() const {
+        return m_sum;
+    }
+
+    // These are NaN if there are no values.
+    double min() const {
+        return m_count > 0 ? m_min : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    double max() const {
+        return m_count > 0 ? m_max : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    double mean() const {
+        return m_count > 0 ? m_sum / m_count
+                           : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // the population variance, dividing by the count
+    double variance() const {
+        return m_count > 0 ? m_squares / m_count
+                           : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // the sample variance, dividing by one less than the count
+    double sampleVariance() const {
+        return m_count > 1 ? m_squares / (m_count - 1)
+                           : std::numeric_limits<double>::quiet_NaN();
+    }
+
+	friend std::ostream& operator<<(std::ostream &out, const CSVStats &stats) {
+		return stats.print(out);
+	}
+
+    std::ostream& print(std::ostream& out) const;
+};
+
+
+#endif // __CSVAGGREGATE_H__
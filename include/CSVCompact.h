@@ -0,0 +1,195 @@
+//============================================================================
+// Name        : CSVCompact.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : A 16 byte cell type for CSV fields, with its short strings
+//               inline and the rest interned in a per-file string pool.
+//============================================================================
+
+#ifndef __CSVCOMPACT_H__
+#define __CSVCOMPACT_H__
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+// Every distinct string is stored once, and is known by its id from then
+// on.  The characters live in fixed blocks that never move, so the views
+// we hand out stay valid for the life of the pool.
+class CSVStringPool
+{
+private:
+    // An open addressing table with linear probing, keyed by the
+    // SpookyHash of the string, kept at most half full.  The slots only
+    // hold the hash and the id, so probing stays within a few cache lines.
+    struct Slot
+    {
+        uint64_t hash;
+        uint32_t id;   // one more than the string's id, 0 if empty
+    };
+
+    std::vector<std::unique_ptr<char[]>> m_blocks{};
+    char *m_current{nullptr};   // the block we are filling
+    size_t m_blockUsed{0};
+    size_t m_bytes{0};
+
+    std::vector<std::string_view> m_strings{};
+    std::vector<Slot> m_slots{};
+    size_t m_mask{0};
+
+    static const size_t sc_blockSize = 64 * 1024;
+    static constexpr size_t sc_initialSlots = 1024;
+
+    std::string_view store(std::string_view str);
+    size_t findSlot(std::string_view str, uint64_t hash) const;
+    void grow();
+public:
+    CSVStringPool() {}
+
+    CSVStringPool(const CSVStringPool&) = delete;
+    CSVStringPool& operator=(const CSVStringPool&) = delete;
+    CSVStringPool(CSVStringPool&&) = default;
+    CSVStringPool& operator=(CSVStringPool&&) = default;
+
+    // the id of str, adding it to the pool if we have not seen it before
+    uint32_t intern(std::string_view str);
+
+    // Looks up str without adding it.  Returns false if it is not pooled,
+    // in which case no cell can be equal to it.
+    bool find(std::string_view str, uint32_t &id) const;
+
+    std::string_view view(uint32_t id) const {
+        return m_strings[id];
+    }
+
+    // the number of distinct strings
+    size_t size() const {
+        return m_strings.size();
+    }
+
+    // the number of characters stored
+    size_t bytes() const {
+        return m_bytes;
+    }
+};
+
+
+// A cell in 16 bytes: a tag, and either a double, a string of up to
+// sc_inlineLength characters held in the cell itself, or the id of a
+// longer string in a CSVStringPool.  Short strings, which most of our
+// fields are, never touch the pool.  Since a string is inline exactly when
+// it is short, and pooled strings are unique, two string cells from the
+// same pool are equal exactly when their characters or ids are.
+class alignas(8) CompactCell
+{
+public:
+    enum class Type : uint8_t
+    {
+        Missing,
+        Number,
+        String
+    };
+
+    static constexpr size_t sc_inlineLength = 14;
+
+private:
+    static constexpr uint8_t sc_pooled = 0xff;
+
+    // the double, the id, or the characters, copied in and out so the
+    // cell can hold any of them in 14 bytes
+    char m_data[sc_inlineLength] = {};
+    uint8_t m_length{0};   // of an inline string, or sc_pooled
+    Type m_type{Type::Missing};
+public:
+    CompactCell() {}
+
+    CompactCell(double number)
+        : m_type{Type::Number}
+    {
+        std::memcpy(m_data, &number, sizeof(number));
+    }
+
+    static CompactCell string(uint32_t id) {
+        CompactCell cell{};
+        std::memcpy(cell.m_data, &id, sizeof(id));
+        cell.m_length = sc_pooled;
+        cell.m_type = Type::String;
+        return cell;
+    }
+
+    // str must be at most sc_inlineLength characters
+    static CompactCell inlineString(std::string_view str) {
+        CompactCell cell{};
+        std::memcpy(cell.m_data, str.data(), str.size());
+        cell.m_length = str.size();
+        cell.m_type = Type::String;
+        return cell;
+    }
+
+    Type type() const {
+        return m_type;
+    }
+
+    bool isNumber() const {
+        return m_type == Type::Number;
+    }
+
+    bool isString() const {
+        return m_type == Type::String;
+    }
+
+    // whether a string's characters are in the cell, rather than the pool
+    bool isInline() const {
+        return m_type == Type::String && m_length != sc_pooled;
+    }
+
+    double number() const {
+        double number;
+        std::memcpy(&number, m_data, sizeof(number));
+        return number;
+    }
+
+    // only for strings that are not inline
+    uint32_t stringId() const {
+        uint32_t id;
+        std::memcpy(&id, m_data, sizeof(id));
+        return id;
+    }
+
+    // A string's characters, from the cell itself or from pool.  An inline
+    // string's view is only valid as long as this cell is.
+    std::string_view view(const CSVStringPool &pool) const {
+        if (isInline()) {
+            return std::string_view{m_data, m_length};
+        }
+        return pool.view(stringId());
+    }
+
+    bool operator==(const CompactCell &other) const {
+        if (m_type != other.m_type) {
+            return false;
+        }
+        else if (m_type == Type::Number) {
+            return number() == other.number();
+        }
+        else if (m_type == Type::String) {
+            return m_length == other.m_length &&
+                   std::memcmp(m_data, other.m_data,
+                               isInline() ? m_length : sizeof(uint32_t)) == 0;
+        }
+        return true;
+    }
+
+    bool operator!=(const CompactCell &other) const {
+        return !(*this == other);
+    }
+};
+
+static_assert(sizeof(CompactCell) == 16, "CompactCell should be 16 bytes");
+
+
+#endif // __CSVCOMPACT_H__
@@ -10,9 +10,20 @@
 #ifndef __CSVFILE_H__
 #define __CSVFILE_H__
 
+#include <iostream>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <variant>
 #include <vector>
 #include <string>
+#include <string_view>
+
+#include "CSVAggregate.h"
+#include "CSVCompact.h"
+#include "MappedFile.h"
 
 class Exception
 {
@@ -39,9 +50,52 @@ public:
 };
 
 
+class StorageError : public Exception
+{
+public:
+    StorageError(std::string error) : Exception(error) {}
+};
+
+
+class TypeError : public Exception
+{
+public:
+    TypeError(std::string error) : Exception(error) {}
+};
+
+
 // We are trying out variants to solve the problem of arbitrary data types
 // coming from CSV fields.
-using Cell = std::variant<double, std::string>;
+//
+// A std::string_view cell borrows its characters from the memory mapped
+// file of the CSVFile it came from, and is only valid as long as that
+// CSVFile is.
+using Cell = std::variant<double, std::string, std::string_view>;
+
+// A non-owning look at a Cell, cheap to copy.  It is only valid as long
+// as the cell it was taken from.
+using CellView = std::variant<double, std::string_view>;
+
+inline CellView toCellView(const Cell &cell) {
+    if (std::holds_alternative<double>(cell)) {
+        return std::get<double>(cell);
+    }
+    else if (std::holds_alternative<std::string>(cell)) {
+        return std::string_view{std::get<std::string>(cell)};
+    }
+    else {
+        return std::get<std::string_view>(cell);
+    }
+}
+
+// An owning copy of a cell, for whatever has to outlive the storage the
+// view looks into.
+inline Cell toCell(CellView cell) {
+    if (std::holds_alternative<double>(cell)) {
+        return std::get<double>(cell);
+    }
+    return std::string{std::get<std::string_view>(cell)};
+}
 
 
 struct CellPrint
@@ -64,14 +118,93 @@ struct CellPrint
     void operator()(const std::string& s) const { 
         m_out << s; 
     }
+    void operator()(std::string_view s) const { 
+        m_out << s; 
+    }
+};
+
+
+// How the fields of a line are separated, and whether they can be quoted.
+// The default is our tab separated files, where a quote is just a
+// character.
+//
+//     CSVOptions options{};
+//     options.dialect = CSVDialect{',', true};   // RFC 4180 CSV
+struct CSVDialect
+{
+    char delimiter{'\t'};
+
+    // A field starting with a double quote runs to the matching one, and
+    // may hold delimiters and newlines, and quotes written twice ("").
+    // Its cell is the text between the quotes, with the doubled quotes
+    // made single; quoted numbers are still numbers.  A quote anywhere
+    // else in a field is just a character.  A carriage return ending a
+    // line is dropped, for CRLF files, and a delimiter ending one starts
+    // an empty last field.
+    bool quoting{false};
+
+    bool isDefault() const {
+        return delimiter == '\t' && !quoting;
+    }
+};
+
+
+// Which columns of a file we load.  The cells of the other columns are
+// never converted or copied; they are left as empty strings, the same as
+// nulls, so every column keeps its original index.
+//
+//     CSVOptions options{};
+//     options.columns = CSVProjection{{0, 3, 158}};
+//
+// A filter is called from the parsing threads, so it has to be safe to
+// call from several at once.
+class CSVProjection
+{
+private:
+    std::vector<char> m_keep{};
+    std::function<bool(int)> m_filter{};
+    bool m_all{true};
+
+    // a filter's answers for the columns below this are looked up
+    static const int sc_cachedColumns = 1024;
+public:
+    // every column
+    CSVProjection() {}
+
+    // Just these columns, counting from 0.  Throws an IndexError for a
+    // negative one, since we cannot know yet how wide the rows are.
+    CSVProjection(const std::vector<int> &columns);
+
+    // the columns filter says yes to
+    CSVProjection(std::function<bool(int)> filter);
+
+    bool all() const {
+        return m_all;
+    }
+
+    bool keeps(int column) const {
+        if (static_cast<size_t>(column) < m_keep.size()) {
+            return m_keep[column];
+        }
+        return m_filter ? m_filter(column) : m_all;
+    }
 };
 
 
 class CSVRow
 {
 private:
+    void addFields(std::string_view strRow,
+                   const std::vector<uint32_t> &fieldEnds,
+                   bool borrowFields, const CSVProjection *projection,
+                   bool quoting);
+
+    Cell getQuotedField(std::string_view field, bool borrowField);
 protected:
-    std::vector<Cell> m_fields{};
+    // Rows normally allocate from the default heap, but a CSVFile can have
+    // them allocate from its arena instead.  Copies always go back to the
+    // default heap.
+    std::pmr::vector<Cell> m_fields{};
 public:
     CSVRow() {
         // std::cout << "CSVRow()...\n";
@@ -83,7 +216,40 @@ public:
 
     CSVRow(std::string &strRow);
 
+    // If borrowFields is set, string cells are views into strRow instead
+    // of copies, so strRow has to outlive the row.  With a projection, the
+    // fields it does not keep become empty strings.  Without a dialect,
+    // fields are separated by tabs and never quoted.
+    CSVRow(std::string_view strRow, bool borrowFields,
+           const CSVProjection *projection = nullptr,
+           const CSVDialect *dialect = nullptr);
+
+    // fieldEnds holds the offset in strRow where each field ends, as
+    // produced by CSVScanner::forEachRow().  A quoted field whose quotes
+    // are doubled cannot be borrowed, so it is copied.
+    CSVRow(std::string_view strRow, const std::vector<uint32_t> &fieldEnds,
+           bool borrowFields,
+           std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource(),
+           const CSVProjection *projection = nullptr,
+           bool quoting = false);
+
+    CSVRow(std::pmr::vector<Cell> fields)
+        : m_fields{std::move(fields)}
+    {}
+
+    // our destructor would otherwise cost us the implicit move operations
+    CSVRow(const CSVRow&) = default;
+    CSVRow(CSVRow&&) = default;
+    CSVRow& operator=(const CSVRow&) = default;
+    CSVRow& operator=(CSVRow&&) = default;
+
     Cell getField(std::string &field);
+    Cell getField(std::string_view field, bool borrowField);
+
+    // Does what reading a double from a std::stringstream of field would
+    // do, without the stream.  Returns false where the stream would fail.
+    static bool parseNumber(std::string_view field, double &number);
 
     int size() const {
         return m_fields.size();
@@ -105,17 +271,150 @@ public:
 };
 
 
+// One column of a CSVFile kept in columnar form.  Every row has a slot in
+// the contiguous m_numbers vector (0.0 if the cell is not a number), and
+// string cells are packed back to back in a single arena.  Two bitmaps tell
+// us which rows hold a number and which hold a string.  Rows holding
+// neither are shorter than this column.
+class CSVColumnData
+{
+private:
+    std::vector<double> m_numbers{};
+    std::vector<uint64_t> m_numberBits{};
+    std::vector<uint64_t> m_stringBits{};
+    std::vector<uint32_t> m_stringEnds{};
+    std::string m_arena{};
+
+    static bool testBit(const std::vector<uint64_t> &bits, size_t row) {
+        return (bits[row / 64] >> (row % 64)) & 1;
+    }
+
+    void grow();
+public:
+    size_t size() const {
+        return m_numbers.size();
+    }
+
+    bool isNumber(size_t row) const {
+        return testBit(m_numberBits, row);
+    }
+
+    bool isString(size_t row) const {
+        return testBit(m_stringBits, row);
+    }
+
+    bool isMissing(size_t row) const {
+        return !isNumber(row) && !isString(row);
+    }
+
+    double number(size_t row) const {
+        return m_numbers[row];
+    }
+
+    std::string_view string(size_t row) const {
+        uint32_t start = (row == 0) ? 0 : m_stringEnds[row - 1];
+        return std::string_view{m_arena}.substr(start,
+                                                m_stringEnds[row] - start);
+    }
+
+    // String cells come back as copies, which outlive us.
+    Cell cell(size_t row) const;
+
+    CellView cellView(size_t row) const {
+        if (isNumber(row)) {
+            return number(row);
+        }
+        else {
+            return string(row);  // empty if missing
+        }
+    }
+
+    // the raw column of numbers, one per row
+    const std::vector<double>& numbers() const {
+        return m_numbers;
+    }
+
+    // which rows hold a number, bit row % 64 of word row / 64
+    const std::vector<uint64_t>& numberBits() const {
+        return m_numberBits;
+    }
+
+    void append(const Cell &cell);
+    void appendMissing();
+};
+
+
+class CSVFile;
+
+
+// A cheap reference to one column of a CSVFile, whatever its storage.
+// It is only valid as long as the CSVFile it came from.
+class CSVColumnView
+{
+private:
+    const CSVFile *m_file{nullptr};
+    const CSVColumnData *m_data{nullptr};
+    const double *m_numbers{nullptr};
+    const uint64_t *m_numberBits{nullptr};
+    int m_index{0};
+public:
+    CSVColumnView(const CSVFile &file, int index);
+
+    int index() const {
+        return m_index;
+    }
+
+    int size() const;
+
+    // Rows that are too short for this column give us an empty string.
+    // Strings are copied out.
+    Cell operator[] (int row) const;
+
+    // the same without copying anything
+    CellView cellView(int row) const;
+
+    // the underlying columnar storage, or nullptr if the file is not
+    // stored by column
+    const CSVColumnData* data() const {
+        return m_data;
+    }
+
+    // A number for every row, and a bitmap of the rows that really hold
+    // one, bit row % 64 of word row / 64.  Both are nullptr unless the
+    // storage keeps its numbers contiguous.
+    const double* numbers() const {
+        return m_numbers;
+    }
+
+    const uint64_t* numberBits() const {
+        return m_numberBits;
+    }
+
+	friend std::ostream& operator<<(std::ostream &out,
+                                    const CSVColumnView &view) {
+		return view.print(out);
+	}
+
+    std::ostream& print(std::ostream& out) const;
+};
+
+
 class CSVColumn : public CSVRow
 {
 private:
 public:
     CSVColumn(const std::vector<CSVRow>& rows, int index);
+    CSVColumn(const std::vector<CSVRow>& rows, int index, int max_len);
+    CSVColumn(const CSVColumnView &view);
 
 	~CSVColumn() {
 		// std::cerr << "CSVColumn cleaned up\n";
 	}
 
-    int max_length(const std::vector<CSVRow> &rows);
+    static int max_length(const std::vector<CSVRow> &rows);
+
+    // statistics over the numbers in the column
+    CSVStats aggregate(CSVStringPolicy policy = CSVStringPolicy::Skip) const;
 
 	friend std::ostream& operator<<(std::ostream &out, const CSVColumn &col) {
 		return col.print(out);
@@ -125,20 +424,355 @@ public:
 };
 
 
+// A cheap reference to one row of a CSVFile, whatever its storage.  It is
+// only valid as long as the CSVFile it came from.
+class CSVRowView
+{
+private:
+    const CSVFile *m_file{nullptr};
+    int m_index{0};
+    int m_size{0};
+public:
+    CSVRowView(const CSVFile &file, int index);
+
+    int size() const {
+        return m_size;
+    }
+
+    // no bounds checking
+    CellView operator[] (int column) const;
+
+    // Negative numbers count back from the end, and anything out of
+    // range throws an IndexError.
+    CellView at(int column) const;
+
+	friend std::ostream& operator<<(std::ostream &out,
+                                    const CSVRowView &view) {
+		return view.print(out);
+	}
+
+    std::ostream& print(std::ostream& out) const;
+};
+
+
+enum class CSVType
+{
+    Empty,    // nothing but empty or missing cells
+    Number,
+    String,
+    Mixed     // both numbers and strings
+};
+
+
+// What we learn about a file's shape while loading it, so questions about
+// it do not have to rescan the rows.  Empty strings and the cells missing
+// from short rows both count as nulls.
+class CSVSchema
+{
+private:
+    int m_rows{0};
+    int m_minFields{0};
+    int m_maxFields{0};
+    std::vector<int> m_numbers{};
+    std::vector<int> m_strings{};
+public:
+    CSVSchema() {}
+
+    // a schema we already know, such as the one saved in a CSVSnapshot
+    CSVSchema(int rows, int minFields, int maxFields,
+              std::vector<int> numbers, std::vector<int> strings)
+        : m_rows{rows}, m_minFields{minFields}, m_maxFields{maxFields},
+          m_numbers{std::move(numbers)}, m_strings{std::move(strings)}
+    {}
+
+    void update(const CSVRow &row);
+
+    // counts a row of this many fields without looking at them
+    void updateShape(int fields);
+
+    int rows() const {
+        return m_rows;
+    }
+
+    // the fewest and most fields in any row
+    int minFields() const {
+        return m_minFields;
+    }
+
+    int maxFields() const {
+        return m_maxFields;
+    }
+
+    int columns() const {
+        return m_maxFields;
+    }
+
+    int numberCount(int column) const {
+        return m_numbers[column];
+    }
+
+    int stringCount(int column) const {
+        return m_strings[column];
+    }
+
+    int nullCount(int column) const {
+        return m_rows - m_numbers[column] - m_strings[column];
+    }
+
+    CSVType type(int column) const;
+
+	friend std::ostream& operator<<(std::ostream &out,
+                                    const CSVSchema &schema) {
+		return schema.print(out);
+	}
+
+    std::ostream& print(std::ostream& out) const;
+};
+
+
+enum class CSVStorage
+{
+    Rows,     // a CSVRow for every line
+    Columns,  // a CSVColumnData for every column
+    Compact,  // a CompactCell for every field, long strings interned
+    Snapshot, // read in place from a memory mapped CSVSnapshot
+    Lazy      // where each field is in the text, typed when it is read
+};
+
+
+struct CSVOptions
+{
+    // Map the file into memory and parse it in place.  String cells are
+    // then std::string_view slices of the mapping instead of copies.
+    // Gzip and zstd files are always decompressed into memory instead,
+    // on a thread of their own while we parse.
+    bool mapped{false};
+
+    CSVStorage storage{CSVStorage::Rows};
+
+    // Parse with this many threads, each taking its own byte range of the
+    // file.  Zero means one per hardware thread.
+    int threads{1};
+
+    // With CSVStorage::Rows, take the text of the file and the rows' cell
+    // vectors from a few large blocks owned by the CSVFile, all freed
+    // together when it goes.  String cells become views into the arena's
+    // copy of the text.
+    bool arena{false};
+
+    // The path of a binary snapshot of the file.  If it exists and was
+    // made from a source with the same contents, we map it instead of
+    // parsing, and the storage becomes CSVStorage::Snapshot.  Otherwise we
+    // parse the source as the other options say, and write a new
+    // snapshot for next time.
+    std::string snapshot{};
+
+    // With CSVStorage::Lazy, type a whole column the first time any of
+    // its cells is read, and keep its numbers.  Later reads are lookups,
+    // and the column's numbers are contiguous for aggregate().
+    bool memoize{false};
+
+    // Only convert and keep the cells of these columns; the rest are
+    // left as empty strings.  A projected load still reads an up to date
+    // snapshot, which has every column, but never writes one.
+    CSVProjection columns{};
+
+    // Remember where the last complete line of the file ended, so that
+    // refresh() can parse just the lines appended since.  A last line
+    // with no newline yet is left for a later refresh to finish.  A
+    // followed file cannot be loaded from a snapshot, and cannot be
+    // compressed.
+    bool follow{false};
+
+    // How the fields are separated and quoted.  Quoting cannot be used
+    // with lazy storage.
+    CSVDialect dialect{};
+
+    // Files that are not mapped are read a few large blocks ahead of the
+    // parser, by io_uring or a thread.  This reads them with O_DIRECT,
+    // past the page cache, where the file system allows it: for files
+    // too big to cache, which would only push out what is there.
+    bool direct{false};
+};
+
+
+class CSVSnapshot;
+
+
 class CSVFile
 {
 private:
+    CSVStorage m_storage{CSVStorage::Rows};
+
+    // One arena per parsing thread, since they are not thread safe.  They
+    // have to outlive the rows allocated from them.
+    std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>>
+        m_arenas{};
+
     std::vector<CSVRow> m_rows{};
+    std::unique_ptr<MappedFile> m_mapping{};
+
+    // columnar storage
+    std::vector<CSVColumnData> m_columns{};
+    std::vector<int> m_rowSizes{};
+
+    // compact storage, row i being m_cells[m_rowStarts[i]] up to
+    // m_cells[m_rowStarts[i + 1]]
+    std::vector<CompactCell> m_cells{};
+    std::vector<size_t> m_rowStarts{0};
+    CSVStringPool m_pool{};
+
+    // Lazy storage, row i being the line at m_text[m_lineStarts[i]] whose
+    // fields end at m_fieldEnds[m_rowStarts[i]] up to
+    // m_fieldEnds[m_rowStarts[i + 1]].  The text is the mapping or our
+    // own copy of the file.  Nothing is typed until it is read.
+    struct LazyColumn
+    {
+        std::vector<double> numbers{};
+        std::vector<uint64_t> numberBits{};
+    };
+
+    std::string m_lazyText{};
+    std::string_view m_text{};
+    std::vector<size_t> m_lineStarts{};
+    std::vector<uint32_t> m_fieldEnds{};
+    bool m_memoize{false};
+    mutable std::unique_ptr<std::once_flag[]> m_columnOnce{};
+    mutable std::vector<LazyColumn> m_lazyColumns{};
+    mutable std::once_flag m_schemaOnce{};
+    mutable CSVSchema m_typedSchema{};
+
+    // snapshot storage
+    std::unique_ptr<CSVSnapshot> m_snapshot{};
+
+    std::string m_filePath{};
+    CSVProjection m_projection{};
+    CSVDialect m_dialect{};
+    CSVSchema m_schema{};
+
+    // follow mode
+    bool m_following{false};
+    int m_threads{1};
+    size_t m_followOffset{0};   // just past the last complete line parsed
+    size_t m_followSize{0};     // the size of the file when we last looked
+    std::string m_followBuffer{};
+    int m_notifyFd{-1};
+
+    // chunks smaller than this are not worth a thread
+    static constexpr size_t sc_minChunkSize = 1 << 20;
+
+    // the size of the first block each arena takes from the heap
+    static constexpr size_t sc_arenaChunkSize = 16 << 20;
+
+    // how often waitForChange() looks at the file without inotify
+    static constexpr int sc_followPollMs = 50;
+
+    // columns shorter than this are not worth reducing on threads
+    static constexpr size_t sc_minAggregateRows = 1 << 16;
+
+    void loadMapped(const std::string &filePath, int threads);
+    void loadChunks(const std::string &filePath, int threads,
+                    bool useArena, bool direct);
+    void loadFollowed(bool mapped);
+    void loadLazy(const std::string &filePath, bool mapped, bool direct);
+    std::string_view lazyField(int row, int column) const;
+    const LazyColumn& lazyColumn(int column) const;
+    CellView lazyCellView(int row, int column) const;
+    const CSVSchema& lazySchema() const;
+    void reserveRows(size_t rows);
+    // the size and hashes of the source a snapshot of ours was made from
+    void hashSource(uint64_t &size, uint64_t &hash1, uint64_t &hash2) const;
+    bool loadSnapshot(const std::string &snapshotPath, uint64_t sourceSize,
+                      uint64_t sourceHash1, uint64_t sourceHash2);
+    std::pmr::memory_resource* arena(int thread);
+    void parseText(std::string_view text, bool borrowFields, int threads);
+    void addRow(CSVRow &&row);
+    CSVRow buildRow(int index) const;
+    CSVStats aggregateRows(int column, size_t begin, size_t end) const;
+
+    int normalizeRow(int index) const;
+    int normalizeColumn(int index) const;
+    void requireRows() const;
+
+    // Unchecked access for the views, where a column past the end of the
+    // row is an empty string.  cellAt() copies strings out, cellViewAt()
+    // borrows them.
+    int rowSize(int row) const;
+    CellView cellViewAt(int row, int column) const;
+    Cell cellAt(int row, int column) const;
+
+    friend class CSVRowView;
+    friend class CSVColumnView;
 public:
     CSVFile(std::string filePath);
+    CSVFile(std::string filePath, const CSVOptions &options);
 
-	~CSVFile() {
-		std::cerr << "CSVFile cleaned up\n";
-	}
+	~CSVFile();
 
-    CSVRow getRow(int index);
-    CSVColumn getColumn(int index);
-    Cell getCell(int row, int column);
+    CSVStorage storage() const {
+        return m_storage;
+    }
+
+    // the number of rows
+    int size() const {
+        return m_schema.rows();
+    }
+
+    // With CSVStorage::Lazy, the first call types every cell to count
+    // the numbers and strings.
+    const CSVSchema& getSchema() const {
+        if (m_storage == CSVStorage::Lazy) {
+            return lazySchema();
+        }
+        return m_schema;
+    }
+
+    // These copy, so that what they return owns its strings whatever the
+    // storage, and outlives us and refresh().
+    CSVRow getRow(int index) const;
+    CSVColumn getColumn(int index) const;
+    Cell getCell(int row, int column) const;
+
+    // These do not copy anything, and index the same way as the methods
+    // above.  The references only work with CSVStorage::Rows and throw a
+    // StorageError otherwise; the views work with any storage.
+    const CSVRow& getRowRef(int index) const;
+    const Cell& getCellRef(int row, int column) const;
+    CSVRowView getRowView(int index) const;
+    CSVColumnView getColumnView(int index) const;
+    CellView getCellView(int row, int column) const;
+
+    // Statistics over the numbers in a column, reduced straight from the
+    // contiguous numbers of columnar and snapshot storage.  Columns long
+    // enough are split across this many threads, zero meaning one per
+    // hardware thread.
+    CSVStats aggregate(int column,
+                       CSVStringPolicy policy = CSVStringPolicy::Skip,
+                       int threads = 0) const;
+
+    // Only with CSVStorage::Compact.  Cells from the same file can be
+    // compared directly, and CompactCell::view() with the pool gives a
+    // string cell's characters.
+    CompactCell getCompactCell(int row, int column) const;
+    const CSVStringPool& getStringPool() const;
+
+    // With CSVOptions::follow, parses the complete lines appended to the
+    // file since we last looked, and returns how many rows they made.
+    // Views, references and columns taken before may not survive it.
+    // Throws a StorageError if we are not following the file, and a
+    // FileError if it can no longer be read or has been truncated.
+    int refresh();
+
+    // With CSVOptions::follow, waits up to timeout milliseconds for the
+    // file to grow, with inotify where we have it and by polling where we
+    // do not.  Returns whether it grew, in which case refresh() will pick
+    // up any lines that were completed.
+    bool waitForChange(int timeout);
+
+    // Writes a CSVSnapshot of the file.  It records the hash of the
+    // source as it is now, so the source should not have changed since
+    // we loaded it.
+    void saveSnapshot(const std::string &snapshotPath) const;
 
 	friend std::ostream& operator<<(std::ostream &out, const CSVFile &csvFile) {
 		return csvFile.print(out);
@@ -148,4 +782,13 @@ public:
 };
 
 
+inline CellView CSVRowView::operator[] (int column) const {
+    return m_file->cellViewAt(m_index, column);
+}
+
+inline CellView CSVColumnView::cellView(int row) const {
+    return m_file->cellViewAt(row, m_index);
+}
+
+
 #endif // __CSVFILE_H__
@@ -0,0 +1,126 @@
+//============================================================================
+// Name        : CSVGroupBy.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Grouping the rows of a CSVFile by the values in some
+//               columns, and aggregating other columns for each group.
+//============================================================================
+
+#ifndef __CSVGROUPBY_H__
+#define __CSVGROUPBY_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "CSVFile.h"
+
+
+// Groups the rows of a file by their key columns, and keeps a CSVStats of
+// each value column for every group, all in one pass over the rows.
+//
+//     // sum column 7 grouped by column 2
+//     CSVGroupBy groups{csvFile, {2}, {7}};
+//     for (int group = 0; group < groups.size(); ++group) {
+//         ... groups.key(group, 0) ... groups.stats(group, 0).sum() ...
+//     }
+//
+// Groups are numbered in the order their keys first appear in the file.
+// Keys compare the way CellViews do, and the cells missing from short rows
+// are keyed as empty strings.  Value columns treat strings as the policy
+// says.
+//
+// Large files are split into ranges of rows that are grouped on separate
+// threads, each into its own table, and the tables are then merged in
+// file order.  Each thread gets at least minThreadRows rows, so smaller
+// files are grouped on fewer threads, or just one.  It refers to the
+// CSVFile for its keys, so it is only valid as long as that CSVFile is.
+class CSVGroupBy
+{
+private:
+    // An open addressing table with linear probing, keyed by the combined
+    // SpookyHash of the key cells.  The slots only hold the hash and the
+    // group number, so probing stays within a few cache lines; the groups
+    // themselves are kept densely, in order of appearance.
+    struct Slot
+    {
+        uint64_t hash;
+        uint32_t group;   // one more than the group number, 0 if empty
+    };
+
+    struct Table
+    {
+        std::vector<Slot> slots{};
+        size_t mask{0};
+        std::vector<uint64_t> hashes{};   // of each group's key
+        std::vector<int> firstRows{};
+        std::vector<int> rowCounts{};
+        std::vector<CSVStats> stats{};    // values per group, group by group
+    };
+
+    const CSVFile *m_file{nullptr};
+    std::vector<int> m_keyColumns{};
+    std::vector<CSVColumnView> m_values{};
+    CSVStringPolicy m_policy{CSVStringPolicy::Skip};
+    Table m_table{};
+
+    // rows per thread below which threads are not worth it
+    static constexpr size_t sc_minThreadRows = 1 << 16;
+
+    static constexpr size_t sc_initialSlots = 1024;
+
+    // keys are hashed this many rows at a time
+    static constexpr int sc_hashBatch = 256;
+
+    uint64_t keyHash(const CSVRowView &row, uint64_t firstHash) const;
+    bool sameKey(const CSVRowView &row, int otherRow) const;
+    int findGroup(const Table &table, uint64_t hash,
+                  const CSVRowView &row) const;
+    int addGroup(Table &table, uint64_t hash, int row) const;
+    void grow(Table &table) const;
+    void groupRows(Table &table, int begin, int end) const;
+    void mergeTable(const Table &other);
+public:
+    CSVGroupBy(const CSVFile &file, std::vector<int> keyColumns,
+               std::vector<int> valueColumns,
+               CSVStringPolicy policy = CSVStringPolicy::Skip,
+               int threads = 0, size_t minThreadRows = sc_minThreadRows);
+
+    // the number of groups
+    int size() const {
+        return m_table.firstRows.size();
+    }
+
+    // a group's cell in the keyIndex'th key column
+    CellView key(int group, int keyIndex) const {
+        return m_file->getRowView(m_table.firstRows[group])
+                   [m_keyColumns[keyIndex]];
+    }
+
+    // the first row of a group, and how many rows it has
+    int firstRow(int group) const {
+        return m_table.firstRows[group];
+    }
+
+    int rows(int group) const {
+        return m_table.rowCounts[group];
+    }
+
+    // the statistics of the valueIndex'th value column over a group
+    const CSVStats& stats(int group, int valueIndex) const {
+        return m_table.stats[group * m_values.size() + valueIndex];
+    }
+
+    // the group with these key cells, or -1 if there is none
+    int findGroup(const std::vector<CellView> &key) const;
+
+	friend std::ostream& operator<<(std::ostream &out,
+                                    const CSVGroupBy &groups) {
+		return groups.print(out);
+	}
+
+    std::ostream& print(std::ostream& out) const;
+};
+
+
+#endif // __CSVGROUPBY_H__
@@ -0,0 +1,93 @@
+//============================================================================
+// Name        : CSVIndex.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : A hash index on one column of a CSVFile, for finding rows
+//               by their value in that column.
+//============================================================================
+
+#ifndef __CSVINDEX_H__
+#define __CSVINDEX_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "CSVFile.h"
+
+
+// Built once over a column, it finds the rows holding a given value in
+// expected constant time.  Keys compare the way CellViews do, so the
+// number 1 does not match the string "1", and cells past the end of a
+// short row are found by the empty string.
+//
+//     CSVIndex index{csvFile, 0};
+//     int row = index.findRow("CL");
+//
+// It refers to the CSVFile for its keys, so it is only valid as long as
+// that CSVFile is.
+class CSVIndex
+{
+private:
+    // One per distinct key, in an open addressing table with linear
+    // probing that grows with the keys rather than the rows.  The key's
+    // rows are m_rows[start] up to m_rows[start + count], in file order;
+    // an empty slot has no rows.
+    struct Slot
+    {
+        uint64_t hash;
+        uint32_t start;
+        uint32_t count;
+    };
+
+    const CSVFile *m_file{nullptr};
+    int m_column{0};
+
+    std::vector<Slot> m_slots{};
+    size_t m_mask{0};
+    std::vector<int> m_rows{};
+    size_t m_keys{0};
+
+    // keys are hashed this many at a time
+    static constexpr size_t sc_hashBatch = 256;
+
+    // the table starts this big, and doubles as keys fill it
+    static constexpr size_t sc_initialSlots = 16;
+
+    CellView key(int row) const;
+    void grow();
+    const Slot* find(CellView key) const;
+public:
+    CSVIndex(const CSVFile &file, int column);
+
+    // The SpookyHash of a key.  Keys of several cells can be hashed by
+    // passing each cell the hash of the ones before it as the seed.
+    static uint64_t hash(CellView key, uint64_t seed = 0);
+
+    // The hashes of many keys, all with the same seed, hashed in batches
+    // with SpookyHash::Hash64Batch.
+    static void hash(const CellView *keys, size_t count, uint64_t *hashes,
+                     uint64_t seed = 0);
+
+    // the column we index
+    int column() const {
+        return m_column;
+    }
+
+    // the number of distinct keys
+    size_t size() const {
+        return m_keys;
+    }
+
+    // the first row holding key, or -1 if there is none
+    int findRow(CellView key) const;
+
+    // every row holding key, in file order
+    std::vector<int> findRows(CellView key) const;
+
+    // the number of rows holding key
+    int count(CellView key) const;
+};
+
+
+#endif // __CSVINDEX_H__
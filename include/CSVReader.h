@@ -0,0 +1,138 @@
+//============================================================================
+// Name        : CSVReader.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Single pass, row at a time reading of a CSV file
+//               (comma separated values)
+//============================================================================
+
+#ifndef __CSVREADER_H__
+#define __CSVREADER_H__
+
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CSVFile.h"
+#include "CompressedFile.h"
+#include "CSVScanner.h"
+#include "ReadAheadFile.h"
+
+
+// Reads a file one row at a time through a fixed size buffer, so memory
+// use does not depend on the size of the file.  Only a line longer than
+// the buffer makes it grow.  A file, rather than a stream, is read a few
+// blocks ahead of us by a ReadAheadFile.
+//
+//     CSVReader reader{"prices.tsv"};
+//     for (const CSVRow &row : reader) {
+//         ...
+//     }
+//
+// The rows own their strings, so they can be kept after the reader moves
+// on, but the row handed out by the iterator is overwritten by the next
+// one.  A gzip or zstd file is decompressed on another thread as we read.
+// With a quoting dialect, a row ends at the first newline outside quotes.
+class CSVReader
+{
+private:
+    std::unique_ptr<ReadAheadFile> m_readAhead{};
+    std::unique_ptr<CompressedFile> m_compressed{};
+    std::istream *m_in{nullptr};
+
+    std::vector<char> m_buffer{};
+    size_t m_start{0};   // first unread byte in m_buffer
+    size_t m_end{0};     // one past the last byte read into m_buffer
+    bool m_eof{false};
+
+    CSVDialect m_dialect{};
+    CSVScanner m_scanner{};
+
+    // how far past m_start we have looked for the end of the line, and
+    // the quotes we were in there
+    size_t m_searched{0};
+    CSVScanner::LineState m_lineState{};
+
+    CSVRow m_row{};
+    long m_rowNumber{-1};
+
+    bool fill();
+public:
+    static const size_t sc_defaultBufferSize = 1 << 20;
+
+    CSVReader(std::string filePath, size_t bufferSize = sc_defaultBufferSize,
+              CSVDialect dialect = CSVDialect{});
+    CSVReader(std::istream &in, size_t bufferSize = sc_defaultBufferSize,
+              CSVDialect dialect = CSVDialect{});
+
+    CSVReader(const CSVReader&) = delete;
+    CSVReader& operator=(const CSVReader&) = delete;
+
+    // Reads the next non-empty line into row.  Returns false at the end of
+    // the input.
+    bool readRow(CSVRow &row);
+
+    // the index of the last row read, counting from 0
+    long rowNumber() const {
+        return m_rowNumber;
+    }
+
+    class iterator
+    {
+    private:
+        CSVReader *m_reader{nullptr};
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = CSVRow;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const CSVRow*;
+        using reference = const CSVRow&;
+
+        iterator() {}
+
+        iterator(CSVReader *reader)
+            : m_reader{reader}
+        {
+            ++(*this);
+        }
+
+        reference operator*() const {
+            return m_reader->m_row;
+        }
+
+        pointer operator->() const {
+            return &m_reader->m_row;
+        }
+
+        iterator& operator++() {
+            if (!m_reader->readRow(m_reader->m_row)) {
+                m_reader = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return m_reader == other.m_reader;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return m_reader != other.m_reader;
+        }
+    };
+
+    // Starts reading from wherever the reader is; the input can only be
+    // iterated once.
+    iterator begin() {
+        return iterator{this};
+    }
+
+    iterator end() {
+        return iterator{};
+    }
+};
+
+
+#endif // __CSVREADER_H__
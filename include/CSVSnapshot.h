@@ -0,0 +1,177 @@
+//============================================================================
+// Name        : CSVSnapshot.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : A binary, columnar snapshot of a parsed CSVFile that can be
+//               memory mapped back in without parsing anything.
+//============================================================================
+
+#ifndef __CSVSNAPSHOT_H__
+#define __CSVSNAPSHOT_H__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "CSVFile.h"
+#include "MappedFile.h"
+
+
+// The file holds, in order and each starting on an 8 byte boundary:
+//
+//     the header below
+//     the number of fields in each row              uint32_t[rows]
+//     the schema's number and string counts         uint32_t[2 * columns]
+//     for each column:
+//         a bitmap of the rows holding a number     uint64_t[(rows + 63) / 64]
+//         a value for each row                      uint64_t[rows]
+//     the end offset of each dictionary string      uint64_t[strings]
+//     the characters of the dictionary strings
+//
+// A value is the bits of the double for a number cell, or the dictionary
+// id of a string cell.  Cells past the end of their row are zero.
+//
+// The header records the size and SpookyHash of the source text, so a
+// snapshot can be checked against the file it was made from.  Everything
+// is stored in the byte order of the machine that wrote it, and a
+// snapshot from a machine of the other byte order is refused.
+class CSVSnapshot
+{
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t fileSize;
+        uint64_t sourceSize;
+        uint64_t sourceHash1;
+        uint64_t sourceHash2;
+        uint32_t rows;
+        uint32_t minFields;
+        uint32_t maxFields;
+        uint32_t unused;
+        uint64_t strings;
+    };
+
+    MappedFile m_mapping;
+    Header m_header{};
+
+    const uint32_t *m_rowSizes{nullptr};
+    const uint32_t *m_counts{nullptr};
+    const uint64_t *m_columns{nullptr};
+    size_t m_bitmapWords{0};
+    const uint64_t *m_stringEnds{nullptr};
+    const char *m_chars{nullptr};
+
+    static constexpr char sc_magic[8] = {'C', 'S', 'V', 'S', 'N', 'A', 'P',
+                                         '\0'};
+    // version 2 holds the source's SpookyHash::HashTree128
+    static const uint32_t sc_version = 2;
+    static const uint32_t sc_byteOrder = 0x01020304;
+
+    static size_t align(size_t offset) {
+        return (offset + 7) & ~size_t{7};
+    }
+
+    const uint64_t* bitmap(int column) const {
+        return m_columns + column * (m_bitmapWords + m_header.rows);
+    }
+
+    uint64_t value(int row, int column) const {
+        return bitmap(column)[m_bitmapWords + row];
+    }
+public:
+    // Maps a snapshot.  Throws a FileError if it cannot be read, and a
+    // StorageError if it is not a snapshot we understand, or its sections
+    // do not fit in it.
+    CSVSnapshot(const std::string &snapshotPath);
+
+    CSVSnapshot(const CSVSnapshot&) = delete;
+    CSVSnapshot& operator=(const CSVSnapshot&) = delete;
+
+    // Writes a snapshot of csvFile, which was parsed from a source of
+    // sourceSize bytes with the given hash.  The snapshot is written
+    // beside snapshotPath and renamed over it, so a reader never sees half
+    // a snapshot.
+    static void write(const CSVFile &csvFile, const std::string &snapshotPath,
+                      uint64_t sourceSize, uint64_t sourceHash1,
+                      uint64_t sourceHash2);
+
+    // the size and SpookyHash::HashTree128 of a file's contents
+    static void hashFile(const std::string &filePath, uint64_t &size,
+                         uint64_t &hash1, uint64_t &hash2);
+
+    // whether this snapshot was made from a source with this content
+    bool matches(uint64_t sourceSize, uint64_t sourceHash1,
+                 uint64_t sourceHash2) const {
+        return m_header.sourceSize == sourceSize &&
+               m_header.sourceHash1 == sourceHash1 &&
+               m_header.sourceHash2 == sourceHash2;
+    }
+
+    CSVSchema schema() const;
+
+    int rows() const {
+        return m_header.rows;
+    }
+
+    int columns() const {
+        return m_header.maxFields;
+    }
+
+    int rowSize(int row) const {
+        return m_rowSizes[row];
+    }
+
+    // No bounds checking; column has to be within the row.
+    bool isNumber(int row, int column) const {
+        return (bitmap(column)[row / 64] >> (row % 64)) & 1;
+    }
+
+    double number(int row, int column) const {
+        uint64_t bits = value(row, column);
+        double number;
+
+        std::memcpy(&number, &bits, sizeof(number));
+        return number;
+    }
+
+    // The string is a view into the mapping, valid as long as we are.
+    // Throws a StorageError if the snapshot has no such string, which
+    // only a corrupt one would not.
+    std::string_view string(int row, int column) const {
+        uint64_t id = value(row, column);
+
+        if (id >= m_header.strings) {
+            throw StorageError{"StorageError: snapshot strings are corrupt!"};
+        }
+
+        uint64_t start = (id == 0) ? 0 : m_stringEnds[id - 1];
+
+        return std::string_view{m_chars + start, m_stringEnds[id] - start};
+    }
+
+    // A column's value for every row, which are only numbers where
+    // numberBits() says so.
+    const double* numbers(int column) const {
+        return reinterpret_cast<const double*>(bitmap(column)
+                                               + m_bitmapWords);
+    }
+
+    const uint64_t* numberBits(int column) const {
+        return bitmap(column);
+    }
+
+    CellView cellView(int row, int column) const {
+        if (isNumber(row, column)) {
+            return number(row, column);
+        }
+        return string(row, column);
+    }
+};
+
+
+#endif // __CSVSNAPSHOT_H__
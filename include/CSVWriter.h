@@ -0,0 +1,130 @@
+//============================================================================
+// Name        : CSVWriter.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Fast buffered output of cells, rows and whole CSV files.
+//============================================================================
+
+#ifndef __CSVWRITER_H__
+#define __CSVWRITER_H__
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "CSVFile.h"
+
+
+enum class CSVFormat
+{
+    Debug,  // ((a, b), (c, d)), as print() writes it
+    TSV,    // a line per row, tab separated
+    CSV     // a line per row, comma separated, quoted as RFC 4180 says
+};
+
+
+// Formats cells straight into a large buffer of its own, and hands the
+// buffer over in one bulk write whenever it fills, to a file descriptor
+// or a std::ostream.  Numbers are formatted with std::to_chars.
+//
+//     CSVWriter writer{"out.tsv"};
+//     writer.writeFile(csvFile);
+//
+// The Debug format writes numbers the way the std::ostream would, to its
+// precision and with its std::fixed, std::scientific, std::showpos and
+// the like, so print() can go through us unchanged.  TSV and CSV write
+// the shortest text that reads back as the same double.  TSV has no way
+// of escaping tabs or newlines, so strings holding them come back as
+// more than one field; CSV quotes them.  A row ending in an empty field
+// gets another tab in TSV, or "" in CSV if it is the only field, so
+// that reading it back gives the same fields.
+//
+// The destructor flushes what is left but cannot report a failure, so
+// call flush() or close() first if that matters.
+class CSVWriter
+{
+private:
+    std::unique_ptr<char[]> m_buffer{};
+    size_t m_capacity{0};
+    size_t m_used{0};
+
+    int m_fd{-1};
+    std::ostream *m_out{nullptr};
+
+    CSVFormat m_format{CSVFormat::TSV};
+    int m_precision{6};
+
+    // the stream's flags that change how it writes numbers
+    std::ios_base::fmtflags m_numberFlags{};
+
+    static constexpr size_t sc_defaultBufferSize = 1 << 20;
+
+    // room for any number we format
+    static constexpr size_t sc_maxNumberSize = 64;
+
+    void put(char c) {
+        if (m_used == m_capacity) {
+            flush();
+        }
+        m_buffer[m_used++] = c;
+    }
+
+    void put(std::string_view text);
+    void putNumber(double number);
+    void putStreamNumber(double number);
+    void putString(std::string_view text);
+    void putDelimiter();
+    void endRow(int fields, bool lastEmpty);
+
+    char delimiter() const {
+        return (m_format == CSVFormat::CSV) ? ',' : '\t';
+    }
+
+    void bulkWrite(const char *data, size_t size);
+public:
+    // Creates or truncates a file.  Throws a FileError if we cannot.
+    CSVWriter(const std::string &filePath, CSVFormat format = CSVFormat::TSV,
+              size_t bufferSize = sc_defaultBufferSize);
+
+    CSVWriter(std::ostream &out, CSVFormat format = CSVFormat::Debug,
+              size_t bufferSize = sc_defaultBufferSize);
+
+    CSVWriter(const CSVWriter&) = delete;
+    CSVWriter& operator=(const CSVWriter&) = delete;
+
+    ~CSVWriter();
+
+    CSVFormat format() const {
+        return m_format;
+    }
+
+    // A cell on its own, with no delimiter or quoting around it other
+    // than what a CSV string needs.
+    void writeCell(CellView cell);
+
+    void writeCell(const Cell &cell) {
+        writeCell(toCellView(cell));
+    }
+
+    // A row, or a column written out the same way.  In the Debug format
+    // this is "(a, b, c)" with nothing after it; otherwise it is a line.
+    void writeRow(const CSVRow &row);
+    void writeRow(const CSVRowView &row);
+    void writeColumn(const CSVColumnView &column);
+
+    // every row of the file, as print() would, or a line each
+    void writeFile(const CSVFile &csvFile);
+
+    // Writes out the buffer.  Throws a FileError if writing to a file
+    // fails; a stream keeps its failures in its own state.
+    void flush();
+
+    // Flushes, and closes the file if we opened one.
+    void close();
+};
+
+
+#endif // __CSVWRITER_H__
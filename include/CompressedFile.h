@@ -0,0 +1,130 @@
+//============================================================================
+// Name        : CompressedFile.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Reading a gzip or zstd compressed file, decompressed on a
+//               thread of its own.
+//============================================================================
+
+#ifndef __COMPRESSEDFILE_H__
+#define __COMPRESSEDFILE_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+enum class Compression
+{
+    None,
+    Gzip,   // including files of several gzip members, as pigz writes
+    Zstd
+};
+
+
+// Decompresses a file on a thread of its own into a small ring of
+// buffers, which the reader takes in turn as they fill.  Decompression
+// runs ahead of the reader by at most the whole ring, so memory use does
+// not depend on the size of the file, and the two overlap.
+//
+//     CompressedFile inFile{"prices.tsv.gz"};
+//     std::string_view chunk;
+//     while (inFile.next(chunk)) {
+//         ...
+//     }
+//
+// Which compression a file has is told from its first bytes, not its
+// name.  Gzip needs zlib and zstd needs libzstd when we are built;
+// opening a file whose compression we were built without throws a
+// FileError, as does a corrupt or truncated file when the reader gets
+// to the bad part.
+class CompressedFile
+{
+private:
+    struct Buffer
+    {
+        std::unique_ptr<char[]> data{};
+        size_t size{0};
+    };
+
+    int m_fd{-1};
+    Compression m_compression{Compression::None};
+
+    std::vector<Buffer> m_ring{};
+    size_t m_bufferSize{0};
+
+    // Between the two threads, under m_mutex.  The m_filled buffers from
+    // m_head on are the reader's, including the one it holds; the rest
+    // are the decompressor's.
+    std::mutex m_mutex{};
+    std::condition_variable m_filledChanged{};
+    size_t m_head{0};
+    size_t m_filled{0};
+    bool m_done{false};
+    bool m_stop{false};
+    std::exception_ptr m_error{};
+
+    // the reader's side
+    bool m_holding{false};
+    std::string_view m_rest{};
+
+    std::thread m_worker{};
+
+    static constexpr size_t sc_defaultBufferSize = 1 << 20;
+    static constexpr int sc_defaultBuffers = 4;
+
+    // compressed bytes read from the file at a time
+    static constexpr size_t sc_inputSize = 1 << 18;
+
+    void decompress();
+    void inflateGzip();
+    void decompressZstd();
+
+    size_t readInput(char *input, size_t size);
+
+    // A buffer the decompressor can fill, once the reader has handed one
+    // back; nullptr if we are being closed.
+    Buffer* emptyBuffer();
+
+    // hands the buffer emptyBuffer() gave us over to the reader
+    void filledBuffer(Buffer *buffer, size_t size);
+public:
+    // Starts decompressing straight away.  Throws a FileError if the file
+    // cannot be opened, or is not compressed in a way we can read.
+    CompressedFile(const std::string &filePath,
+                   size_t bufferSize = sc_defaultBufferSize,
+                   int buffers = sc_defaultBuffers);
+    ~CompressedFile();
+
+    CompressedFile(const CompressedFile&) = delete;
+    CompressedFile& operator=(const CompressedFile&) = delete;
+
+    // How a file is compressed, from its first few bytes; None if it is
+    // not, or cannot be read.
+    static Compression detect(const std::string &filePath);
+
+    // whether we were built able to read this compression
+    static bool supports(Compression compression);
+
+    Compression compression() const {
+        return m_compression;
+    }
+
+    // Hands back the last chunk and waits for the next, which stays
+    // valid until the next call.  Returns false at the end of the file.
+    bool next(std::string_view &chunk);
+
+    // Copies out up to size bytes, fewer only at the end of the file.
+    // Use either this or next(), not both.
+    size_t read(char *out, size_t size);
+};
+
+
+#endif // __COMPRESSEDFILE_H__
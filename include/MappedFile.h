@@ -0,0 +1,46 @@
+//============================================================================
+// Name        : MappedFile.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Read-only memory mapping of a whole file.
+//============================================================================
+
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+// Maps a file read-only into our address space for as long as the object
+// lives.  Anything holding pointers or views into the mapping must not
+// outlive it.
+class MappedFile
+{
+private:
+    const char *m_data{nullptr};
+    size_t m_size{0};
+public:
+    MappedFile(const std::string &filePath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    std::string_view view() const {
+        return std::string_view{m_data, m_size};
+    }
+};
+
+
+#endif // __MAPPEDFILE_H__
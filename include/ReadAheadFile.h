@@ -0,0 +1,142 @@
+//============================================================================
+// Name        : ReadAheadFile.h
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Reading a file in large blocks, ahead of whoever is using
+//               them.
+//============================================================================
+
+#ifndef __READAHEADFILE_H__
+#define __READAHEADFILE_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+enum class ReadAheadBackend
+{
+    Thread,   // a thread of our own reading the blocks in turn
+    IoUring   // the kernel reads them, several at once, with no thread
+};
+
+
+// Reads a file through a small ring of large blocks, the next few always
+// being read while the reader works on the one it has, so reading and
+// parsing overlap instead of taking turns.
+//
+//     ReadAheadFile inFile{"prices.tsv"};
+//     std::string_view chunk;
+//     while (inFile.next(chunk)) {
+//         ...
+//     }
+//
+// Regular files are read with io_uring where we were built with it and
+// the kernel lets us; anything else, or a kernel without it, gets a
+// thread reading ahead.  With direct, regular files are read with
+// O_DIRECT, bypassing the page cache, if their file system allows it.
+class ReadAheadFile
+{
+private:
+    struct AlignedDelete
+    {
+        void operator()(char *data) const;
+    };
+
+    struct Block
+    {
+        std::unique_ptr<char[], AlignedDelete> data{};
+        size_t size{0};
+
+        // io_uring's side
+        uint64_t offset{0};
+        int result{0};
+        bool pending{false};
+    };
+
+    struct Ring;
+
+    int m_fd{-1};
+    ReadAheadBackend m_backend{ReadAheadBackend::Thread};
+    bool m_direct{false};   // opened with O_DIRECT
+
+    // the size of a regular file when we opened it
+    uint64_t m_fileSize{0};
+    bool m_regular{false};
+
+    std::vector<Block> m_blocks{};
+    size_t m_blockSize{0};
+    size_t m_head{0};
+    bool m_holding{false};
+    std::string_view m_rest{};
+
+    // io_uring's side: the ring.  Where the next block to queue starts,
+    // or for the thread, the next block of a regular file to read.
+    std::unique_ptr<Ring> m_ring{};
+    uint64_t m_nextOffset{0};
+
+    // The thread's side, under m_mutex.  The m_filled blocks from m_head
+    // on are the reader's, including the one it holds.
+    std::mutex m_mutex{};
+    std::condition_variable m_filledChanged{};
+    size_t m_filled{0};
+    bool m_done{false};
+    bool m_stop{false};
+    std::exception_ptr m_error{};
+    std::thread m_worker{};
+
+    static constexpr size_t sc_defaultBlockSize = 1 << 20;
+    static constexpr int sc_defaultBlocks = 3;
+
+    // what O_DIRECT needs buffers, offsets and lengths aligned to
+    static constexpr size_t sc_alignment = 4096;
+
+    void readAhead();
+    size_t readBlock(char *data);
+
+    // Reads the bytes of a block at offset from done up to wanted, and
+    // returns how many it then has, fewer only at the end of the file.
+    size_t readAt(char *data, size_t done, size_t wanted, uint64_t offset);
+
+    bool startRing();
+    void queueBlock(Block &block);
+    void waitForBlock(Block &block);
+    void finishBlock(Block &block);
+
+    bool nextQueued(std::string_view &chunk);
+    bool nextRead(std::string_view &chunk);
+public:
+    // Starts reading straight away.  Throws a FileError if the file
+    // cannot be opened.
+    ReadAheadFile(const std::string &filePath, bool direct = false,
+                  size_t blockSize = sc_defaultBlockSize,
+                  int blocks = sc_defaultBlocks);
+    ~ReadAheadFile();
+
+    ReadAheadFile(const ReadAheadFile&) = delete;
+    ReadAheadFile& operator=(const ReadAheadFile&) = delete;
+
+    ReadAheadBackend backend() const {
+        return m_backend;
+    }
+
+    // Hands back the last chunk and waits for the next, which stays
+    // valid until the next call.  Returns false at the end of the file,
+    // and throws a FileError if reading fails.
+    bool next(std::string_view &chunk);
+
+    // Copies out up to size bytes, fewer only at the end of the file.
+    // Use either this or next(), not both.
+    size_t read(char *out, size_t size);
+};
+
+
+#endif // __READAHEADFILE_H__
@@ -82,6 +82,88 @@ public:
         return (uint32)hash1;
     }
 
+    //
+    // Hash64Batch: hash many messages, giving the same results as calling
+    // Hash64 on each of them.  Short messages are finished several at a
+    // time, interleaved so their ShortEnd chains run side by side, in AVX2
+    // registers if the processor has them.
+    //
+    static void Hash64Batch(
+        const void *const *messages,  // the messages to hash
+        const size_t *lengths,        // length of each message in bytes
+        size_t count,                 // number of messages
+        uint64 seed,                  // seed, the same for every message
+        uint64 *hashes);              // out: the hash of each message
+
+    //
+    // HashTree128: hash a large message on several threads
+    //
+    // The message is cut into chunks of sc_treeChunkSize bytes, each chunk
+    // is hashed with Hash128 on its own, and the chunk hashes are hashed
+    // together.  This is NOT the same hash as Hash128.  The result does not
+    // depend on the number of threads, only on sc_treeVersion, which will
+    // change if the way we cut or combine ever does.
+    //
+    static void HashTree128(
+        const void *message,  // message to hash
+        size_t length,        // length of message in bytes
+        uint64 *hash1,        // in/out: in seed 1, out hash value 1
+        uint64 *hash2,        // in/out: in seed 2, out hash value 2
+        int threads = 0);     // threads to use, 0 for one per core
+
+    //
+    // HashFile128: HashTree128 of the contents of a file, read by mapping
+    // it into memory.  Returns false if the file could not be read.
+    //
+    static bool HashFile128(
+        const char *path,     // file to hash
+        uint64 *hash1,        // in/out: in seed 1, out hash value 1
+        uint64 *hash2,        // in/out: in seed 2, out hash value 2
+        int threads = 0);     // threads to use, 0 for one per core
+
+    // the version of HashTree128's chunking and combining
+    static const uint32 sc_treeVersion = 1;
+
+    // the size of each chunk HashTree128 hashes separately
+    static constexpr size_t sc_treeChunkSize = 1 << 20;
+
+    //
+    // The ways we have of mixing the blocks of long messages.  They all
+    // give the same hashes.  Hash128 and Update use Best(), the fastest
+    // this processor can run, unless configure --disable-spooky-dispatch
+    // built us with only the portable one.
+    //
+    enum Impl
+    {
+        Portable,  // plain C++, reading unaligned blocks as configured
+        BMI2       // the same, built to rotate with rorx
+    };
+
+    static Impl Best();
+    static const char *Name(Impl impl);
+    static bool Supported(Impl impl);  // whether this processor can run it
+
+    //
+    // Hash128 with a particular Impl, which must be Supported, for tests
+    // that check each one.
+    //
+    static void Hash128(
+        Impl impl,            // how to mix the blocks of long messages
+        const void *message,  // message to hash
+        size_t length,        // length of message in bytes
+        uint64 *hash1,        // in/out: in seed 1, out hash value 1
+        uint64 *hash2);       // in/out: in seed 2, out hash value 2
+
+    //
+    // Verify: check every Impl this processor can run, and Update and
+    // Hash64Batch, against known answers for messages of every length up
+    // to sc_verifyLength bytes at every alignment.  Returns false if any
+    // of them gives a wrong hash.
+    //
+    static bool Verify();
+
+    static const size_t sc_verifyLength = 1024;
+
     //
     // Init: initialize the context of a SpookyHash
     //
@@ -271,6 +353,46 @@ private:
         uint64 *hash1,        // in/out: in the seed, out the hash value
         uint64 *hash2);       // in/out: in the seed, out the hash value
 
+    //
+    // ShortStart is all of Short but the final ShortEnd, leaving the
+    // state in a, b, c, d.  Hash64Batch ends several of them together.
+    //
+    static INLINE void ShortStart(
+        const void *message,  // message (array of bytes, not necessarily aligned)
+        size_t length,        // length of message (in bytes)
+        uint64 &a, uint64 &b, uint64 &c, uint64 &d);
+
+    typedef void (*MixBlocksFn)(const uint8 *blocks, size_t count,
+                                uint64 *state);
+
+    //
+    // Mix count whole blocks of sc_blockSize bytes into the sc_numVars
+    // words of state.  MixBlocksAt reads the blocks in place.  MixBlocks
+    // copies them out first if they are unaligned and unaligned reads are
+    // not allowed.  MixBlocksBMI2 is MixBlocksAt built for BMI2, and only
+    // exists on x86.
+    //
+    static INLINE void MixBlocksAt(const uint8 *blocks, size_t count,
+                                   uint64 *state);
+    static void MixBlocks(const uint8 *blocks, size_t count, uint64 *state);
+    static void MixBlocksBMI2(const uint8 *blocks, size_t count,
+                              uint64 *state);
+    static MixBlocksFn MixBlocksFor(Impl impl);
+
+    //
+    // Hash128With is Hash128, mixing the blocks of long messages with
+    // mixBlocks
+    //
+    static void Hash128With(
+        MixBlocksFn mixBlocks,
+        const void *message,
+        size_t length,
+        uint64 *hash1,
+        uint64 *hash2);
+
+    // number of messages Hash64Batch ends together
+    static const size_t sc_batchLanes = 8;
+
     // number of uint64's in internal state
     static const size_t sc_numVars = 12;
 
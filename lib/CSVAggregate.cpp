@@ -0,0 +1,152 @@
+//============================================================================
+// Name        : CSVAggregate.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Summary statistics over the numbers in a column of a CSV
+//               file.
+//============================================================================
+
+#include <algorithm>
+
+#include "CSVAggregate.h"
+
+
+// Reduces a run of values with four independent accumulators, so the adds
+// do not wait on each other and the compiler can keep them in vector
+// registers.  The squared differences need the mean, so they take a second
+// pass, which is cheap while the values are still in cache.
+void CSVStats::addBlock(const double *values, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    double sums[4] = {0.0, 0.0, 0.0, 0.0};
+    double mins[4] = {values[0], values[0], values[0], values[0]};
+    double maxs[4] = {values[0], values[0], values[0], values[0]};
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        for (int lane = 0; lane < 4; ++lane) {
+            double value = values[i + lane];
+
+            sums[lane] += value;
+            mins[lane] = value < mins[lane] ? value : mins[lane];
+            maxs[lane] = value > maxs[lane] ? value : maxs[lane];
+        }
+    }
+    for (; i < count; ++i) {
+        sums[0] += values[i];
+        mins[0] = std::min(mins[0], values[i]);
+        maxs[0] = std::max(maxs[0], values[i]);
+    }
+
+    CSVStats block{};
+
+    block.m_count = count;
+    block.m_sum = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    block.m_min = std::min(std::min(mins[0], mins[1]),
+                           std::min(mins[2], mins[3]));
+    block.m_max = std::max(std::max(maxs[0], maxs[1]),
+                           std::max(maxs[2], maxs[3]));
+
+    double mean = block.m_sum / count;
+    double squares[4] = {0.0, 0.0, 0.0, 0.0};
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        for (int lane = 0; lane < 4; ++lane) {
+            double difference = values[i + lane] - mean;
+            squares[lane] += difference * difference;
+        }
+    }
+    for (; i < count; ++i) {
+        double difference = values[i] - mean;
+        squares[0] += difference * difference;
+    }
+
+    block.m_squares = (squares[0] + squares[1]) + (squares[2] + squares[3]);
+
+    merge(block);
+}
+
+void CSVStats::addNumbers(const double *values, const uint64_t *numberBits,
+                          size_t begin, size_t end)
+{
+    double selected[64];
+
+    for (size_t start = begin; start < end; ) {
+        size_t blockEnd = std::min(end, (start / 64 + 1) * 64);
+        uint64_t bits = numberBits[start / 64] >> (start % 64);
+        size_t rows = blockEnd - start;
+
+        if (rows < 64) {
+            bits &= (uint64_t{1} << rows) - 1;
+        }
+
+        if (rows == 64 && bits == ~uint64_t{0}) {
+            // all numbers, which is the usual case for a numeric column
+            addBlock(values + start, 64);
+        }
+        else if (bits != 0) {
+            size_t count = 0;
+
+            while (bits != 0) {
+                selected[count++] = values[start + __builtin_ctzll(bits)];
+                bits &= bits - 1;
+            }
+            addBlock(selected, count);
+        }
+
+        start = blockEnd;
+    }
+}
+
+void CSVStats::addRepeated(double value, size_t times) {
+    if (times == 0) {
+        return;
+    }
+
+    CSVStats repeated{};
+
+    repeated.m_count = times;
+    repeated.m_sum = value * times;
+    repeated.m_min = value;
+    repeated.m_max = value;
+
+    merge(repeated);
+}
+
+// Chan et al.'s formula for combining the squared differences of two sets
+// around their separate means.
+void CSVStats::merge(const CSVStats &other) {
+    if (other.m_count == 0) {
+        return;
+    }
+    else if (m_count == 0) {
+        *this = other;
+        return;
+    }
+
+    double count = m_count;
+    double otherCount = other.m_count;
+    double difference = other.m_sum / otherCount - m_sum / count;
+
+    m_squares += other.m_squares
+                 + difference * difference * count * otherCount
+                   / (count + otherCount);
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+std::ostream& CSVStats::print(std::ostream& out) const {
+    out << "(count: " << count()
+        << ", sum: " << sum()
+        << ", min: " << min()
+        << ", max: " << max()
+        << ", mean: " << mean()
+        << ", variance: " << variance() << ")";
+
+    return out;
+}
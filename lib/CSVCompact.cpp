@@ -0,0 +1,117 @@
+//============================================================================
+// Name        : CSVCompact.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : A 16 byte cell type for CSV fields, with its short strings
+//               inline and the rest interned in a per-file string pool.
+//============================================================================
+
+#include <algorithm>
+
+#include "CSVCompact.h"
+#include "SpookyV2.h"
+
+
+std::string_view CSVStringPool::store(std::string_view str) {
+    if (str.empty()) {
+        return std::string_view{};
+    }
+
+    char *dest;
+
+    if (str.size() > sc_blockSize / 4) {
+        // big strings get a block of their own, so we do not waste the
+        // rest of the current one
+        m_blocks.emplace_back(new char[str.size()]);
+        dest = m_blocks.back().get();
+    }
+    else {
+        if (m_current == nullptr || m_blockUsed + str.size() > sc_blockSize) {
+            m_blocks.emplace_back(new char[sc_blockSize]);
+            m_current = m_blocks.back().get();
+            m_blockUsed = 0;
+        }
+
+        dest = m_current + m_blockUsed;
+        m_blockUsed += str.size();
+    }
+
+    std::memcpy(dest, str.data(), str.size());
+
+    return std::string_view{dest, str.size()};
+}
+
+size_t CSVStringPool::findSlot(std::string_view str, uint64_t hash) const {
+    size_t index = hash & m_mask;
+
+    while (m_slots[index].id != 0) {
+        const Slot &slot = m_slots[index];
+
+        if (slot.hash == hash && m_strings[slot.id - 1] == str) {
+            break;
+        }
+        index = (index + 1) & m_mask;
+    }
+
+    return index;
+}
+
+void CSVStringPool::grow() {
+    size_t capacity = std::max(sc_initialSlots, m_slots.size() * 2);
+    std::vector<Slot> slots(capacity, Slot{0, 0});
+
+    m_mask = capacity - 1;
+
+    for (const Slot &slot : m_slots) {
+        if (slot.id != 0) {
+            size_t index = slot.hash & m_mask;
+
+            while (slots[index].id != 0) {
+                index = (index + 1) & m_mask;
+            }
+            slots[index] = slot;
+        }
+    }
+
+    m_slots.swap(slots);
+}
+
+uint32_t CSVStringPool::intern(std::string_view str) {
+    // keep the table at most half full
+    if (2 * (m_strings.size() + 1) > m_slots.size()) {
+        grow();
+    }
+
+    uint64_t hash = SpookyHash::Hash64(str.data(), str.size(), 0);
+    size_t index = findSlot(str, hash);
+
+    if (m_slots[index].id != 0) {
+        return m_slots[index].id - 1;
+    }
+
+    std::string_view stored = store(str);
+    uint32_t id = m_strings.size();
+
+    m_strings.push_back(stored);
+    m_slots[index] = Slot{hash, id + 1};
+    m_bytes += stored.size();
+
+    return id;
+}
+
+bool CSVStringPool::find(std::string_view str, uint32_t &id) const {
+    if (m_slots.empty()) {
+        return false;
+    }
+
+    size_t index = findSlot(str, SpookyHash::Hash64(str.data(), str.size(),
+                                                    0));
+
+    if (m_slots[index].id == 0) {
+        return false;
+    }
+
+    id = m_slots[index].id - 1;
+    return true;
+}
@@ -8,56 +8,437 @@
 //============================================================================
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include "CSVFile.h"
+#include "CompressedFile.h"
+#include "CSVScanner.h"
+#include "CSVSnapshot.h"
+#include "CSVWriter.h"
+#include "ReadAheadFile.h"
+
+
+CSVRow::CSVRow(std::string &strRow)
+    : CSVRow(std::string_view{strRow}, false)
+{}
+
+CSVProjection::CSVProjection(const std::vector<int> &columns)
+    : m_all{false}
+{
+    for (int column : columns) {
+        if (column < 0) {
+            throw IndexError{"IndexError: column number too small!"};
+        }
+
+        if (static_cast<size_t>(column) >= m_keep.size()) {
+            m_keep.resize(column + 1, false);
+        }
+        m_keep[column] = true;
+    }
+}
+
+CSVProjection::CSVProjection(std::function<bool(int)> filter)
+    : m_filter{std::move(filter)}, m_all{false}
+{
+    for (int column = 0; column < sc_cachedColumns; ++column) {
+        m_keep.push_back(m_filter(column));
+    }
+}
 
 
-CSVRow::CSVRow(std::string &strRow) {
+CSVRow::CSVRow(std::string_view strRow, bool borrowFields,
+               const CSVProjection *projection, const CSVDialect *dialect)
+{
     if (strRow.length() == 0) return;
 
-    std::stringstream ssRow{strRow};
-    std::string field;
+    static const CSVScanner tabScanner{};
+    thread_local std::vector<uint32_t> fieldEnds{};
+    bool quoting = (dialect != nullptr && dialect->quoting);
+
+    fieldEnds.clear();
+    if (dialect == nullptr || dialect->isDefault()) {
+        tabScanner.scan(strRow.data(), strRow.length(), fieldEnds);
+    }
+    else {
+        CSVScanner scanner{dialect->delimiter, quoting};
+
+        scanner.scan(strRow.data(), strRow.length(), fieldEnds);
+    }
+    fieldEnds.push_back(strRow.length());
 
-    while(std::getline(ssRow, field, '\t')) {
-        m_fields.push_back(getField(field));
+    // like std::getline(), a trailing tab does not start another field,
+    // though a trailing delimiter does with quoting
+    if (!quoting && fieldEnds.size() > 1 &&
+        fieldEnds.back() == fieldEnds[fieldEnds.size() - 2] + 1)
+    {
+        fieldEnds.pop_back();
     }
+
+    addFields(strRow, fieldEnds, borrowFields, projection, quoting);
 }
 
-Cell CSVRow::getField(std::string &field) {
+CSVRow::CSVRow(std::string_view strRow,
+               const std::vector<uint32_t> &fieldEnds,
+               bool borrowFields,
+               std::pmr::memory_resource *resource,
+               const CSVProjection *projection, bool quoting)
+    : m_fields{resource}
+{
+    addFields(strRow, fieldEnds, borrowFields, projection, quoting);
+}
+
+void CSVRow::addFields(std::string_view strRow,
+                       const std::vector<uint32_t> &fieldEnds,
+                       bool borrowFields, const CSVProjection *projection,
+                       bool quoting)
+{
+    size_t start = 0;
+
+    m_fields.reserve(fieldEnds.size());
+
+    if (quoting) {
+        size_t fields = fieldEnds.size();
+
+        // the CR of a CRLF line ending is not part of the last field
+        if (!strRow.empty() && strRow.back() == '\r' && fields > 0 &&
+            fieldEnds.back() == strRow.length())
+        {
+            strRow.remove_suffix(1);
+        }
+
+        for (size_t column = 0; column < fields; ++column) {
+            uint32_t end = std::min<size_t>(fieldEnds[column],
+                                            strRow.length());
+            std::string_view field = strRow.substr(start, end - start);
+
+            if (projection != nullptr && !projection->keeps(column)) {
+                m_fields.emplace_back(std::string_view{});
+            }
+            else if (!field.empty() && field[0] == '"') {
+                m_fields.push_back(getQuotedField(field, borrowFields));
+            }
+            else {
+                m_fields.push_back(getField(field, borrowFields));
+            }
+            start = end + 1;
+        }
+        return;
+    }
+
+    if (projection == nullptr || projection->all()) {
+        for (uint32_t end : fieldEnds) {
+            m_fields.push_back(getField(strRow.substr(start, end - start),
+                                        borrowFields));
+            start = end + 1;
+        }
+        return;
+    }
+
+    for (size_t column = 0; column < fieldEnds.size(); ++column) {
+        uint32_t end = fieldEnds[column];
+
+        if (projection->keeps(column)) {
+            m_fields.push_back(getField(strRow.substr(start, end - start),
+                                        borrowFields));
+        }
+        else {
+            m_fields.emplace_back(std::string_view{});
+        }
+        start = end + 1;
+    }
+}
+
+Cell CSVRow::getQuotedField(std::string_view field, bool borrowField) {
+    size_t close = field.find('"', 1);
+
+    // the usual case, with no quotes doubled and nothing after the last
+    if (close == field.length() - 1) {
+        return getField(field.substr(1, close - 1), borrowField);
+    }
+
+    std::string text{};
+    size_t start = 1;
+
+    while (start < field.length()) {
+        size_t quote = field.find('"', start);
+
+        if (quote == std::string_view::npos) {
+            // never closed, so it ran to the end of the file
+            text.append(field.substr(start));
+            break;
+        }
+
+        text.append(field.substr(start, quote - start));
+
+        if (quote + 1 < field.length() && field[quote + 1] == '"') {
+            text.push_back('"');
+            start = quote + 2;
+        }
+        else {
+            // anything after the closing quote is kept as it is
+            text.append(field.substr(quote + 1));
+            break;
+        }
+    }
+
     double numField{};
-    std::string strField{};
 
-    std::stringstream ssField{field};
-    ssField >> numField;
+    if (parseNumber(text, numField)) {
+        return numField;
+    }
+
+    return text;
+}
+
+Cell CSVRow::getField(std::string &field) {
+    return getField(std::string_view{field}, false);
+}
 
-    if (ssField.fail()) {
-        ssField.clear();
-        ssField.str(field);
-        std::getline(ssField, strField, '\t');
-        //ssField >> strField;
+Cell CSVRow::getField(std::string_view field, bool borrowField) {
+    double numField{};
 
-        return strField;
+    if (parseNumber(field, numField)) {
+        return numField;
+    }
+    else if (borrowField) {
+        return field;
     }
     else {
-        return numField;
+        return std::string{field};
     }
 }
 
-std::ostream& CSVRow::print(std::ostream& out) const {
-    std::vector<Cell>::const_iterator it;
-    it = this->m_fields.cbegin();
+// printing a row does not need the writer's usual megabyte
+static const size_t sc_printBufferSize = 4096;
 
-    out << "(";
-    while (it + 1 < this->m_fields.cend())  // stop just 1 before the end
-    {
-        std::visit(CellPrint{out}, *it);
-        out << ", ";
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool CSVRow::parseNumber(std::string_view field, double &number) {
+    const char *it = field.data();
+    const char *end = it + field.size();
+
+    // operator>> skips leading white space
+    while (it < end && isSpace(*it)) {
         ++it;
     }
-    std::visit(CellPrint{out}, *it);
-    out << ")";
+
+    const char *numStart = it;
+    bool foundDigits = false;
+
+    if (it < end && (*it == '+' || *it == '-')) {
+        ++it;
+    }
+
+    while (it < end && isDigit(*it)) {
+        foundDigits = true;
+        ++it;
+    }
+
+    if (it < end && *it == '.') {
+        ++it;
+        while (it < end && isDigit(*it)) {
+            foundDigits = true;
+            ++it;
+        }
+    }
+
+    if (!foundDigits) {
+        return false;
+    }
+
+    const char *numEnd = it;
+
+    if (it < end && (*it == 'e' || *it == 'E')) {
+        ++it;
+        if (it < end && (*it == '+' || *it == '-')) {
+            ++it;
+        }
+
+        // operator>> swallows a dangling exponent like "1.5e" and then
+        // fails on it, rather than stopping in front of it
+        if (it == end || !isDigit(*it)) {
+            return false;
+        }
+
+        while (it < end && isDigit(*it)) {
+            ++it;
+        }
+        numEnd = it;
+    }
+
+    // anything after the number is ignored, just like operator>> does
+
+    if (*numStart == '+') {
+        ++numStart;  // std::from_chars() does not take a plus sign
+    }
+
+    std::from_chars_result result = std::from_chars(numStart, numEnd, number);
+
+    if (result.ec == std::errc::result_out_of_range) {
+        // operator>> fails on overflow, but takes whatever strtod() gives
+        // it for an underflow
+        std::string strNumber{numStart, numEnd};
+
+        number = std::strtod(strNumber.c_str(), nullptr);
+        return number != HUGE_VAL && number != -HUGE_VAL;
+    }
+
+    return result.ec == std::errc{} && result.ptr == numEnd;
+}
+
+std::ostream& CSVRow::print(std::ostream& out) const {
+    CSVWriter writer{out, CSVFormat::Debug, sc_printBufferSize};
+
+    writer.writeRow(*this);
+    writer.flush();
+
+    return out;
+}
+
+
+
+
+
+void CSVColumnData::grow() {
+    if (size() % 64 == 0) {
+        m_numberBits.push_back(0);
+        m_stringBits.push_back(0);
+    }
+}
+
+Cell CSVColumnData::cell(size_t row) const {
+    if (isNumber(row)) {
+        return number(row);
+    }
+    else if (isString(row)) {
+        return std::string{string(row)};
+    }
+    else {
+        return std::string{};
+    }
+}
+
+void CSVColumnData::append(const Cell &cell) {
+    if (std::holds_alternative<double>(cell)) {
+        grow();
+        m_numberBits.back() |= uint64_t{1} << (size() % 64);
+        m_numbers.push_back(std::get<double>(cell));
+        m_stringEnds.push_back(m_arena.size());
+        return;
+    }
+
+    std::string_view str = std::holds_alternative<std::string>(cell)
+                           ? std::string_view{std::get<std::string>(cell)}
+                           : std::get<std::string_view>(cell);
+
+    if (m_arena.size() + str.size() > UINT32_MAX) {
+        throw Exception{"Exception: column strings exceed 4GB!"};
+    }
+
+    grow();
+    m_stringBits.back() |= uint64_t{1} << (size() % 64);
+    m_numbers.push_back(0.0);
+    m_arena.append(str);
+    m_stringEnds.push_back(m_arena.size());
+}
+
+void CSVColumnData::appendMissing() {
+    grow();
+    m_numbers.push_back(0.0);
+    m_stringEnds.push_back(m_arena.size());
+}
+
+
+
+
+
+CSVColumnView::CSVColumnView(const CSVFile &file, int index)
+    : m_file{&file}, m_index{index}
+{
+    if (file.m_storage == CSVStorage::Columns) {
+        m_data = &file.m_columns[index];
+        m_numbers = m_data->numbers().data();
+        m_numberBits = m_data->numberBits().data();
+    }
+    else if (file.m_storage == CSVStorage::Snapshot) {
+        m_numbers = file.m_snapshot->numbers(index);
+        m_numberBits = file.m_snapshot->numberBits(index);
+    }
+    else if (file.m_storage == CSVStorage::Lazy && file.m_memoize) {
+        const CSVFile::LazyColumn &typed = file.lazyColumn(index);
+
+        m_numbers = typed.numbers.data();
+        m_numberBits = typed.numberBits.data();
+    }
+}
+
+int CSVColumnView::size() const {
+    return m_file->size();
+}
+
+Cell CSVColumnView::operator[] (int row) const {
+    return m_file->cellAt(row, m_index);
+}
+
+std::ostream& CSVColumnView::print(std::ostream& out) const {
+    CSVWriter writer{out};
+
+    writer.writeColumn(*this);
+    writer.flush();
+
+    return out;
+}
+
+
+
+
+
+CSVRowView::CSVRowView(const CSVFile &file, int index)
+    : m_file{&file}, m_index{index}, m_size{file.rowSize(index)}
+{}
+
+CellView CSVRowView::at(int column) const {
+    if (column < 0) {
+        column = m_size + column;
+    }
+
+    if (column >= m_size) {
+        throw IndexError{"IndexError: column number too big!"};
+    }
+    else if (column < 0) {
+        throw IndexError{"IndexError: column number too small!"};
+    }
+
+    return (*this)[column];
+}
+
+std::ostream& CSVRowView::print(std::ostream& out) const {
+    CSVWriter writer{out, CSVFormat::Debug, sc_printBufferSize};
+
+    writer.writeRow(*this);
+    writer.flush();
 
     return out;
 }
@@ -66,9 +447,22 @@ std::ostream& CSVRow::print(std::ostream& out) const {
 
 
 
-CSVColumn::CSVColumn(const std::vector<CSVRow>& rows, int index) {
-    int max_len{max_length(rows)};
+CSVColumn::CSVColumn(const CSVColumnView &view) {
+    int rows = view.size();
+    m_fields.reserve(rows);
+
+    for (int row = 0; row < rows; ++row) {
+        m_fields.push_back(view[row]);
+    }
+}
+
+CSVColumn::CSVColumn(const std::vector<CSVRow>& rows, int index)
+    : CSVColumn(rows, index, max_length(rows))
+{}
 
+CSVColumn::CSVColumn(const std::vector<CSVRow>& rows, int index,
+                     int max_len)
+{
     if (index < 0) {
         index = max_len + index;
     }
@@ -85,7 +479,10 @@ CSVColumn::CSVColumn(const std::vector<CSVRow>& rows, int index) {
 
     while (it < rows.cend()) {
         if (index >= (*it).size()) {
-            m_fields.push_back("");
+            m_fields.push_back(std::string{});
+        }
+        else if (std::holds_alternative<std::string_view>((*it)[index])) {
+            m_fields.push_back(toCell(toCellView((*it)[index])));
         }
         else {
             m_fields.push_back((*it)[index]);
@@ -109,19 +506,57 @@ int CSVColumn::max_length(const std::vector<CSVRow> &rows) {
     return max_len;
 }
 
-std::ostream& CSVColumn::print(std::ostream& out) const {
-    std::vector<Cell>::const_iterator it;
-    it = m_fields.cbegin();
+// Throws if the policy says to, otherwise applies it to the strings we
+// have counted.
+static void applyStringPolicy(CSVStats &stats, size_t strings,
+                              CSVStringPolicy policy)
+{
+    if (strings == 0) {
+        return;
+    }
+    else if (policy == CSVStringPolicy::Throw) {
+        throw TypeError{"TypeError: column holds strings!"};
+    }
+    else if (policy == CSVStringPolicy::Zero) {
+        stats.addRepeated(0.0, strings);
+    }
+}
 
-    out << "(";
-    while (it + 1 < m_fields.cend())  // stop just 1 before the end
-    {
-        std::visit(CellPrint{out}, *it);
-        out << ", ";
-        ++it;
+CSVStats CSVColumn::aggregate(CSVStringPolicy policy) const {
+    CSVStats stats{};
+    size_t strings = 0;
+    size_t rows = m_fields.size();
+    double values[64];
+
+    for (size_t start = 0; start < rows; start += 64) {
+        size_t blockRows = std::min<size_t>(rows - start, 64);
+        uint64_t bits = 0;
+
+        for (size_t i = 0; i < blockRows; ++i) {
+            CellView cell = toCellView(m_fields[start + i]);
+
+            if (std::holds_alternative<double>(cell)) {
+                values[i] = std::get<double>(cell);
+                bits |= uint64_t{1} << i;
+            }
+            else if (!std::get<std::string_view>(cell).empty()) {
+                ++strings;
+            }
+        }
+
+        stats.addNumbers(values, &bits, 0, blockRows);
     }
-    std::visit(CellPrint{out}, *it);
-    out << ")";
+
+    applyStringPolicy(stats, strings, policy);
+
+    return stats;
+}
+
+std::ostream& CSVColumn::print(std::ostream& out) const {
+    CSVWriter writer{out};
+
+    writer.writeRow(*this);
+    writer.flush();
 
     return out;
 }
@@ -130,68 +565,1070 @@ std::ostream& CSVColumn::print(std::ostream& out) const {
 
 
 
-CSVFile::CSVFile(std::string filePath) {
-    std::ifstream inFile{filePath};
+CSVFile::CSVFile(std::string filePath)
+    : CSVFile(filePath, CSVOptions{})
+{}
 
-    if (!inFile) {
-        throw FileError{"FileException: Could not open file for reading!"};
+CSVFile::CSVFile(std::string filePath, const CSVOptions &options)
+    : m_storage{options.storage}, m_filePath{filePath},
+      m_projection{options.columns}, m_dialect{options.dialect}
+{
+    uint64_t sourceSize = 0, sourceHash1 = 0, sourceHash2 = 0;
+    bool compressed =
+        CompressedFile::detect(filePath) != Compression::None;
+
+    if (options.follow && !options.snapshot.empty()) {
+        throw StorageError{"StorageError: cannot follow a snapshot!"};
+    }
+    else if (options.follow && m_storage == CSVStorage::Lazy) {
+        throw StorageError{"StorageError: cannot follow lazy storage!"};
+    }
+    else if (options.follow && compressed) {
+        throw StorageError{"StorageError: cannot follow a compressed file!"};
+    }
+
+    if (m_dialect.quoting && m_storage == CSVStorage::Lazy) {
+        throw StorageError{"StorageError: cannot read quoted fields "
+                           "lazily!"};
     }
 
-    for(int count=0; inFile;) {
-        std::string strLine;
-        std::getline(inFile, strLine);
+    if (!options.snapshot.empty()) {
+        hashSource(sourceSize, sourceHash1, sourceHash2);
 
-        if (strLine.length() > 0) {
-            m_rows.push_back(strLine);
+        if (loadSnapshot(options.snapshot, sourceSize, sourceHash1,
+                         sourceHash2)) {
+            return;
         }
     }
-}
 
-CSVRow CSVFile::getRow(int index) {
-    if (index < 0) {
-        index = m_rows.size() + index;
-    }
+    int threads = options.threads;
 
-    if (index >= static_cast<int>(m_rows.size())) {
-        throw IndexError{"IndexError: row number too big!"};
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
     }
-    else if (index < 0) {
-        throw IndexError{"IndexError: row number too small!"};
+
+    bool useArena = options.arena && m_storage == CSVStorage::Rows;
+
+    if (useArena) {
+        m_arenas.resize(threads);
     }
 
-    return m_rows[index];
-}
+    m_threads = threads;
 
-CSVColumn CSVFile::getColumn(int index) {
-    return CSVColumn(m_rows, index);
-}
+    if (options.follow) {
+        loadFollowed(options.mapped);
 
-Cell CSVFile::getCell(int row, int column) {
-    CSVRow csvRow{getRow(row)};
+        if (m_storage != CSVStorage::Rows) {
+            m_mapping.reset();
+        }
+        return;
+    }
 
-    if (column < 0) {
-        column = csvRow.size() + column;
+    if (m_storage == CSVStorage::Lazy) {
+        m_memoize = options.memoize;
+        loadLazy(filePath, options.mapped && !compressed, options.direct);
+    }
+    else if (options.mapped && !compressed) {
+        loadMapped(filePath, threads);
+    }
+    else {
+        loadChunks(filePath, threads, useArena, options.direct);
     }
 
-    if (column >= static_cast<int>(csvRow.size())) {
-        throw IndexError{"IndexError: column number too big!"};
+    if (m_storage != CSVStorage::Rows && m_storage != CSVStorage::Lazy) {
+        // every string has been copied into the column arenas or the
+        // string pool
+        m_mapping.reset();
     }
-    else if (column < 0) {
-        throw IndexError{"IndexError: column number too small!"};
+
+    // a snapshot of a projection would be missing the columns we skipped
+    if (!options.snapshot.empty() && m_projection.all()) {
+        try {
+            CSVSnapshot::write(*this, options.snapshot, sourceSize,
+                               sourceHash1, sourceHash2);
+        }
+        catch (const FileError &exc) {
+            // we have what we came for, and the next load will simply
+            // parse the source again
+        }
+    }
+}
+
+CSVFile::~CSVFile() {
+    if (m_notifyFd >= 0) {
+        ::close(m_notifyFd);
     }
 
-    return csvRow[column];
+    std::cerr << "CSVFile cleaned up\n";
 }
 
-std::ostream& CSVFile::print(std::ostream& out) const {
-    std::vector<CSVRow>::const_iterator it;
-    it = m_rows.cbegin();
+void CSVFile::loadMapped(const std::string &filePath, int threads) {
+    m_mapping = std::make_unique<MappedFile>(filePath);
+
+    parseText(m_mapping->view(), true, threads);
+}
+
+// Calls onChunk with each chunk of a file in turn, as a thread or the
+// kernel reads the next ones, decompressing them first if the file is
+// compressed.  A chunk is only valid during its call.
+template <typename Function>
+static void forEachChunk(const std::string &filePath, bool direct,
+                         Function onChunk)
+{
+    std::string_view chunk{};
 
-    out << "(";
-    while (it + 1 < m_rows.cend()) {  // stop just 1 before the end
-        out << *it++ << ", ";
+    if (CompressedFile::detect(filePath) != Compression::None) {
+        CompressedFile inFile{filePath};
+
+        while (inFile.next(chunk)) {
+            onChunk(chunk);
+        }
+    }
+    else {
+        ReadAheadFile inFile{filePath, direct};
+
+        while (inFile.next(chunk)) {
+            onChunk(chunk);
+        }
     }
-    out << *it << ")";
+}
+
+void CSVFile::loadChunks(const std::string &filePath, int threads,
+                         bool useArena, bool direct)
+{
+    CSVScanner scanner{m_dialect.delimiter, m_dialect.quoting};
+
+    // The line a chunk left unfinished, kept until a later chunk finishes
+    // it, and how far it got through any quotes.  It grows as a string
+    // does, so a very long line is only copied a few times over.
+    std::string partial{};
+    CSVScanner::LineState state{};
+
+    // The chunks' buffers are reused, so with an arena each run of
+    // complete lines is copied into it once, for the cells to point at;
+    // otherwise the cells copy their strings out as they are parsed.
+    auto parseLines = [&](std::string_view lines) {
+        if (lines.empty()) {
+            return;
+        }
+
+        if (useArena) {
+            char *block = static_cast<char*>(
+                arena(0)->allocate(lines.size(), 1));
+
+            std::memcpy(block, lines.data(), lines.size());
+            lines = std::string_view{block, lines.size()};
+        }
+
+        parseText(lines, useArena, threads);
+    };
+
+    // A chunk is smaller than parseText splits between threads, so with
+    // threads the complete lines of several chunks are gathered first,
+    // enough for each thread to have a piece.
+    std::string batch{};
+    size_t batchSize = (threads > 1) ? threads * sc_minChunkSize : 0;
+
+    auto addLines = [&](std::string_view lines) {
+        if (batchSize == 0) {
+            parseLines(lines);
+            return;
+        }
+
+        batch.append(lines);
+
+        if (batch.size() >= batchSize) {
+            parseLines(batch);
+            batch.clear();
+        }
+    };
+
+    forEachChunk(filePath, direct, [&](std::string_view chunk) {
+        if (!partial.empty()) {
+            size_t newline = scanner.findNewline(chunk, state);
+
+            if (newline == std::string_view::npos) {
+                partial.append(chunk);
+                return;
+            }
+
+            partial.append(chunk.substr(0, newline + 1));
+            addLines(partial);
+            partial.clear();
+            chunk.remove_prefix(newline + 1);
+        }
+
+        size_t lastNewline = scanner.findLastNewline(chunk);
+        size_t complete = (lastNewline == std::string_view::npos)
+                          ? 0
+                          : lastNewline + 1;
+
+        addLines(chunk.substr(0, complete));
+
+        partial.assign(chunk.substr(complete));
+        state = CSVScanner::LineState{};
+        scanner.findNewline(partial, state);
+    });
+
+    // what is left of the batch, then a last line with no newline
+    batch.append(partial);
+    parseLines(batch);
+}
+
+void CSVFile::loadFollowed(bool mapped) {
+    m_following = true;
+
+    if (!mapped) {
+        refresh();
+        return;
+    }
+
+    m_mapping = std::make_unique<MappedFile>(m_filePath);
+
+    std::string_view text = m_mapping->view();
+    CSVScanner scanner{m_dialect.delimiter, m_dialect.quoting};
+    size_t lastNewline = scanner.findLastNewline(text);
+    size_t complete = (lastNewline == std::string_view::npos)
+                      ? 0
+                      : lastNewline + 1;
+
+    // the lines appended later are read, not mapped, so only these
+    // borrow from the mapping
+    parseText(text.substr(0, complete), true, m_threads);
+    m_followOffset = complete;
+    m_followSize = text.length();
+}
+
+int CSVFile::refresh() {
+    if (!m_following) {
+        throw StorageError{"StorageError: the file is not being followed!"};
+    }
+
+    int fd = ::open(m_filePath.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        throw FileError{"FileException: Could not open file for reading!"};
+    }
+
+    struct stat info;
+
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw FileError{"FileException: Could not stat file!"};
+    }
+
+    size_t fileSize = info.st_size;
+
+    if (fileSize < m_followOffset) {
+        ::close(fd);
+        throw FileError{"FileException: Followed file was truncated!"};
+    }
+    m_followSize = fileSize;
+
+    size_t length = fileSize - m_followOffset;
+
+    if (length == 0) {
+        ::close(fd);
+        return 0;
+    }
+
+    // The new text is read into a buffer we keep for next time.  With an
+    // arena, the complete lines in it are then copied into the arena, for
+    // the cells to borrow from like the rest; a partial last line is read
+    // again next time, so it must not use up the arena poll after poll.
+    bool borrowFields = !m_arenas.empty();
+
+    m_followBuffer.resize(length);
+
+    char *data = m_followBuffer.data();
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t got = ::pread(fd, data + done, length - done,
+                              m_followOffset + done);
+
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (got < 0) {
+            ::close(fd);
+            throw FileError{"FileException: Could not read file!"};
+        }
+        else if (got == 0) {
+            break;  // it shrank as we read
+        }
+        done += got;
+    }
+    ::close(fd);
+
+    // a partial last line is read again next time, once it is finished
+    std::string_view text{data, done};
+    CSVScanner scanner{m_dialect.delimiter, m_dialect.quoting};
+    size_t lastNewline = scanner.findLastNewline(text);
+
+    if (lastNewline == std::string_view::npos) {
+        return 0;
+    }
+
+    size_t complete = lastNewline + 1;
+    int rows = size();
+
+    // guess the new rows from the length of the ones we have
+    if (m_storage == CSVStorage::Rows && rows > 0) {
+        reserveRows(rows + complete * rows / m_followOffset + 1);
+    }
+
+    text = text.substr(0, complete);
+
+    if (borrowFields) {
+        char *lines = static_cast<char*>(arena(0)->allocate(complete, 1));
+
+        std::memcpy(lines, text.data(), complete);
+        text = std::string_view{lines, complete};
+    }
+
+    parseText(text, borrowFields, m_threads);
+    m_followOffset += complete;
+
+    // the first refresh reads the whole file, which we need not hold on to
+    if (m_followBuffer.capacity() > sc_arenaChunkSize) {
+        m_followBuffer = std::string{};
+    }
+
+    return size() - rows;
+}
+
+bool CSVFile::waitForChange(int timeout) {
+    if (!m_following) {
+        throw StorageError{"StorageError: the file is not being followed!"};
+    }
+
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds{timeout};
+
+#ifdef __linux__
+    // watched before we look at the size, so no write can slip between
+    if (m_notifyFd < 0) {
+        m_notifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (m_notifyFd >= 0 &&
+            ::inotify_add_watch(m_notifyFd, m_filePath.c_str(),
+                                IN_MODIFY) < 0)
+        {
+            ::close(m_notifyFd);
+            m_notifyFd = -1;
+        }
+    }
+#endif
+
+    while (true) {
+        struct stat info;
+
+        if (::stat(m_filePath.c_str(), &info) != 0) {
+            throw FileError{"FileException: Could not stat file!"};
+        }
+
+        if (static_cast<size_t>(info.st_size) > m_followSize) {
+            return true;
+        }
+
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+
+        if (remaining <= 0) {
+            return false;
+        }
+
+        if (m_notifyFd >= 0) {
+            pollfd events{m_notifyFd, POLLIN, 0};
+
+            if (::poll(&events, 1, remaining) > 0) {
+                char buffer[4096];
+
+                while (::read(m_notifyFd, buffer, sizeof(buffer)) > 0) {
+                    // we only want to know that something happened
+                }
+            }
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::milliseconds{
+                std::min(remaining, sc_followPollMs)});
+        }
+    }
+}
+
+void CSVFile::reserveRows(size_t rows) {
+    // never just enough, or appending a few rows at a time would copy
+    // them all every time
+    if (rows > m_rows.capacity()) {
+        m_rows.reserve(std::max(rows, 2 * m_rows.capacity()));
+    }
+}
+
+void CSVFile::loadLazy(const std::string &filePath, bool mapped,
+                       bool direct)
+{
+    if (mapped) {
+        m_mapping = std::make_unique<MappedFile>(filePath);
+        m_text = m_mapping->view();
+    }
+    else {
+        forEachChunk(filePath, direct, [&](std::string_view chunk) {
+            m_lazyText.append(chunk);
+        });
+        m_text = m_lazyText;
+    }
+
+    // only find the fields; typing them waits until they are read
+    CSVScanner scanner{m_dialect.delimiter};
+
+    scanner.forEachRow(m_text,
+        [&](std::string_view line, const std::vector<uint32_t> &ends) {
+            m_lineStarts.push_back(line.data() - m_text.data());
+            m_fieldEnds.insert(m_fieldEnds.end(), ends.begin(), ends.end());
+            m_rowStarts.push_back(m_fieldEnds.size());
+            m_schema.updateShape(ends.size());
+        });
+
+    int columns = m_schema.columns();
+
+    m_columnOnce = std::make_unique<std::once_flag[]>(columns);
+    m_lazyColumns.resize(columns);
+}
+
+std::string_view CSVFile::lazyField(int row, int column) const {
+    const uint32_t *ends = &m_fieldEnds[m_rowStarts[row]];
+    uint32_t start = (column == 0) ? 0 : ends[column - 1] + 1;
+
+    return m_text.substr(m_lineStarts[row] + start, ends[column] - start);
+}
+
+const CSVFile::LazyColumn& CSVFile::lazyColumn(int column) const {
+    // typed once, whichever thread gets here first
+    std::call_once(m_columnOnce[column], [&]() {
+        LazyColumn &typed = m_lazyColumns[column];
+        int rows = size();
+        bool keep = m_projection.keeps(column);
+
+        typed.numbers.assign(rows, 0.0);
+        typed.numberBits.assign((rows + 63) / 64, 0);
+
+        for (int row = 0; keep && row < rows; ++row) {
+            double number;
+
+            if (column < rowSize(row) &&
+                CSVRow::parseNumber(lazyField(row, column), number))
+            {
+                typed.numbers[row] = number;
+                typed.numberBits[row / 64] |= uint64_t{1} << (row % 64);
+            }
+        }
+    });
+
+    return m_lazyColumns[column];
+}
+
+CellView CSVFile::lazyCellView(int row, int column) const {
+    if (!m_projection.keeps(column)) {
+        return std::string_view{};
+    }
+
+    std::string_view field = lazyField(row, column);
+
+    if (m_memoize) {
+        const LazyColumn &typed = lazyColumn(column);
+
+        if ((typed.numberBits[row / 64] >> (row % 64)) & 1) {
+            return typed.numbers[row];
+        }
+        return field;
+    }
+
+    double number;
+
+    if (CSVRow::parseNumber(field, number)) {
+        return number;
+    }
+    return field;
+}
+
+const CSVSchema& CSVFile::lazySchema() const {
+    // Kept apart from m_schema, which size() reads without a lock.
+    std::call_once(m_schemaOnce, [&]() {
+        int rows = size();
+        int columns = m_schema.columns();
+        std::vector<int> numbers(columns), strings(columns);
+
+        for (int row = 0; row < rows; ++row) {
+            int fields = rowSize(row);
+
+            for (int column = 0; column < fields; ++column) {
+                CellView cell = lazyCellView(row, column);
+
+                if (std::holds_alternative<double>(cell)) {
+                    ++numbers[column];
+                }
+                else if (!std::get<std::string_view>(cell).empty()) {
+                    ++strings[column];
+                }
+            }
+        }
+
+        m_typedSchema = CSVSchema{rows, m_schema.minFields(),
+                                  m_schema.maxFields(), std::move(numbers),
+                                  std::move(strings)};
+    });
+
+    return m_typedSchema;
+}
+
+bool CSVFile::loadSnapshot(const std::string &snapshotPath,
+                           uint64_t sourceSize, uint64_t sourceHash1,
+                           uint64_t sourceHash2)
+{
+    std::unique_ptr<CSVSnapshot> snapshot{};
+
+    try {
+        snapshot = std::make_unique<CSVSnapshot>(snapshotPath);
+    }
+    catch (const Exception &exc) {
+        return false;  // missing, or not a snapshot we can read
+    }
+
+    if (!snapshot->matches(sourceSize, sourceHash1, sourceHash2)) {
+        return false;  // made from an older version of the source
+    }
+
+    m_schema = snapshot->schema();
+    m_snapshot = std::move(snapshot);
+    m_storage = CSVStorage::Snapshot;
+
+    return true;
+}
+
+std::pmr::memory_resource* CSVFile::arena(int thread) {
+    if (m_arenas.empty()) {
+        return std::pmr::get_default_resource();
+    }
+
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> &resource =
+        m_arenas[thread];
+
+    if (!resource) {
+        resource = std::make_unique<std::pmr::monotonic_buffer_resource>(
+            sc_arenaChunkSize);
+    }
+
+    return resource.get();
+}
+
+void CSVFile::parseText(std::string_view text, bool borrowFields,
+                        int threads)
+{
+    CSVScanner scanner{m_dialect.delimiter, m_dialect.quoting};
+
+    if (threads <= 1 || text.length() < sc_minChunkSize) {
+        std::pmr::memory_resource *resource = arena(0);
+
+        scanner.forEachRow(text,
+            [&](std::string_view line, const std::vector<uint32_t> &ends) {
+                addRow(CSVRow{line, ends, borrowFields, resource,
+                              &m_projection, m_dialect.quoting});
+            });
+        return;
+    }
+
+    threads = std::min<size_t>(threads, text.length() / sc_minChunkSize);
+
+    // Cut the text into roughly equal byte ranges, each moved forward to
+    // start just after a newline so no line is split between two chunks.
+    // With quoting, the newline must be outside quotes, which the quotes
+    // since the last cut tell us.
+    std::vector<size_t> bounds{0};
+
+    for (int chunk = 1; chunk < threads; ++chunk) {
+        size_t start = std::max(bounds.back(),
+                                text.length() * chunk / threads);
+        size_t newline = scanner.findNewline(text.substr(bounds.back()),
+                                             start - bounds.back());
+
+        bounds.push_back(newline == std::string_view::npos
+                         ? text.length()
+                         : bounds.back() + newline + 1);
+    }
+    bounds.push_back(text.length());
+
+    std::vector<std::vector<CSVRow>> chunkRows(threads);
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> workers{};
+    std::vector<std::pmr::memory_resource*> resources{};
+
+    for (int chunk = 0; chunk < threads; ++chunk) {
+        resources.push_back(arena(chunk));
+    }
+
+    for (int chunk = 0; chunk < threads; ++chunk) {
+        workers.emplace_back([&, chunk]() {
+            try {
+                std::vector<CSVRow> &rows = chunkRows[chunk];
+                std::string_view part = text.substr(bounds[chunk],
+                    bounds[chunk + 1] - bounds[chunk]);
+
+                scanner.forEachRow(part,
+                    [&](std::string_view line,
+                        const std::vector<uint32_t> &ends) {
+                        rows.emplace_back(line, ends, borrowFields,
+                                          resources[chunk], &m_projection,
+                                          m_dialect.quoting);
+                    });
+            }
+            catch (...) {
+                errors[chunk] = std::current_exception();
+            }
+        });
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for (std::exception_ptr &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // stitch the chunks back together in file order
+    if (m_storage == CSVStorage::Rows) {
+        size_t total = 0;
+        for (const std::vector<CSVRow> &rows : chunkRows) {
+            total += rows.size();
+        }
+        reserveRows(m_rows.size() + total);
+    }
+
+    for (std::vector<CSVRow> &rows : chunkRows) {
+        for (CSVRow &row : rows) {
+            addRow(std::move(row));
+        }
+        rows = std::vector<CSVRow>{};
+    }
+}
+
+void CSVSchema::updateShape(int fields) {
+    if (m_rows == 0 || fields < m_minFields) {
+        m_minFields = fields;
+    }
+
+    if (fields > m_maxFields) {
+        m_maxFields = fields;
+        m_numbers.resize(fields);
+        m_strings.resize(fields);
+    }
+
+    ++m_rows;
+}
+
+void CSVSchema::update(const CSVRow &row) {
+    int fields = row.size();
+
+    updateShape(fields);
+
+    for (int column = 0; column < fields; ++column) {
+        const Cell &cell = row[column];
+
+        if (std::holds_alternative<double>(cell)) {
+            ++m_numbers[column];
+        }
+        else if (!std::get<std::string_view>(toCellView(cell)).empty()) {
+            ++m_strings[column];
+        }
+    }
+}
+
+CSVType CSVSchema::type(int column) const {
+    if (m_numbers[column] > 0) {
+        return m_strings[column] > 0 ? CSVType::Mixed : CSVType::Number;
+    }
+    else {
+        return m_strings[column] > 0 ? CSVType::String : CSVType::Empty;
+    }
+}
+
+std::ostream& CSVSchema::print(std::ostream& out) const {
+    static const char *typeNames[] = {"empty", "number", "string", "mixed"};
+
+    out << "(rows: " << m_rows
+        << ", fields: " << m_minFields << "-" << m_maxFields;
+
+    for (int column = 0; column < m_maxFields; ++column) {
+        out << ", " << column << ": "
+            << typeNames[static_cast<int>(type(column))]
+            << " " << nullCount(column) << " nulls";
+    }
+    out << ")";
+
+    return out;
+}
+
+void CSVFile::addRow(CSVRow &&row) {
+    m_schema.update(row);
+
+    if (m_storage == CSVStorage::Rows) {
+        m_rows.push_back(std::move(row));
+        return;
+    }
+    else if (m_storage == CSVStorage::Compact) {
+        for (int column = 0; column < row.size(); ++column) {
+            CellView cell = toCellView(row[column]);
+
+            if (std::holds_alternative<double>(cell)) {
+                m_cells.emplace_back(std::get<double>(cell));
+            }
+            else {
+                std::string_view str = std::get<std::string_view>(cell);
+
+                m_cells.push_back(str.size() <= CompactCell::sc_inlineLength
+                                  ? CompactCell::inlineString(str)
+                                  : CompactCell::string(m_pool.intern(str)));
+            }
+        }
+        m_rowStarts.push_back(m_cells.size());
+        return;
+    }
+
+    int rowSize = row.size();
+    int columns = m_columns.size();
+
+    for (int column = 0; column < rowSize || column < columns; ++column) {
+        if (column >= columns) {
+            // a new widest row; earlier rows are too short for this column
+            m_columns.emplace_back();
+            for (size_t i = 0; i < m_rowSizes.size(); ++i) {
+                m_columns.back().appendMissing();
+            }
+        }
+
+        if (column < rowSize) {
+            m_columns[column].append(row[column]);
+        }
+        else {
+            m_columns[column].appendMissing();
+        }
+    }
+
+    m_rowSizes.push_back(rowSize);
+}
+
+CSVRow CSVFile::buildRow(int index) const {
+    std::pmr::vector<Cell> fields{};
+    int fieldCount = rowSize(index);
+
+    fields.reserve(fieldCount);
+    for (int column = 0; column < fieldCount; ++column) {
+        fields.push_back(cellAt(index, column));
+    }
+
+    return CSVRow{std::move(fields)};
+}
+
+CSVStats CSVFile::aggregateRows(int column, size_t begin, size_t end) const {
+    CSVStats stats{};
+    CSVColumnView view{*this, column};
+
+    if (view.numbers() != nullptr) {
+        stats.addNumbers(view.numbers(), view.numberBits(), begin, end);
+        return stats;
+    }
+
+    // gather the numbers 64 rows at a time, so they can be reduced the
+    // same way as a contiguous column
+    double values[64];
+
+    for (size_t start = begin; start < end; start += 64) {
+        size_t blockRows = std::min<size_t>(end - start, 64);
+        uint64_t bits = 0;
+
+        for (size_t i = 0; i < blockRows; ++i) {
+            CellView cell = cellViewAt(start + i, column);
+
+            if (std::holds_alternative<double>(cell)) {
+                values[i] = std::get<double>(cell);
+                bits |= uint64_t{1} << i;
+            }
+        }
+
+        stats.addNumbers(values, &bits, 0, blockRows);
+    }
+
+    return stats;
+}
+
+int CSVFile::rowSize(int row) const {
+    switch (m_storage) {
+    case CSVStorage::Columns:
+        return m_rowSizes[row];
+    case CSVStorage::Compact:
+    case CSVStorage::Lazy:
+        return m_rowStarts[row + 1] - m_rowStarts[row];
+    case CSVStorage::Snapshot:
+        return m_snapshot->rowSize(row);
+    default:
+        return m_rows[row].size();
+    }
+}
+
+CellView CSVFile::cellViewAt(int row, int column) const {
+    if (column >= rowSize(row)) {
+        return std::string_view{};
+    }
+
+    switch (m_storage) {
+    case CSVStorage::Columns:
+        return m_columns[column].cellView(row);
+    case CSVStorage::Compact: {
+        const CompactCell &cell = m_cells[m_rowStarts[row] + column];
+
+        if (cell.isNumber()) {
+            return cell.number();
+        }
+        return cell.view(m_pool);
+    }
+    case CSVStorage::Snapshot:
+        return m_snapshot->cellView(row, column);
+    case CSVStorage::Lazy:
+        return lazyCellView(row, column);
+    default:
+        return toCellView(m_rows[row][column]);
+    }
+}
+
+Cell CSVFile::cellAt(int row, int column) const {
+    if (column >= rowSize(row)) {
+        return std::string{};
+    }
+    else if (m_storage == CSVStorage::Rows &&
+             !std::holds_alternative<std::string_view>(m_rows[row][column]))
+    {
+        return m_rows[row][column];
+    }
+
+    return toCell(cellViewAt(row, column));
+}
+
+int CSVFile::normalizeRow(int index) const {
+    if (index < 0) {
+        index = size() + index;
+    }
+
+    if (index >= size()) {
+        throw IndexError{"IndexError: row number too big!"};
+    }
+    else if (index < 0) {
+        throw IndexError{"IndexError: row number too small!"};
+    }
+
+    return index;
+}
+
+int CSVFile::normalizeColumn(int index) const {
+    int max_len = m_schema.maxFields();
+
+    if (index < 0) {
+        index = max_len + index;
+    }
+
+    if (index >= max_len) {
+        throw IndexError{"IndexError: column number too big!"};
+    }
+    else if (index < 0) {
+        throw IndexError{"IndexError: column number too small!"};
+    }
+
+    return index;
+}
+
+void CSVFile::requireRows() const {
+    if (m_storage != CSVStorage::Rows) {
+        throw StorageError{"StorageError: rows are not stored as CSVRows!"};
+    }
+}
+
+CSVRow CSVFile::getRow(int index) const {
+    index = normalizeRow(index);
+
+    if (m_storage != CSVStorage::Rows) {
+        return buildRow(index);
+    }
+
+    // mapped and arena rows borrow their strings from us
+    CSVRow row = m_rows[index];
+
+    for (int column = 0; column < row.size(); ++column) {
+        if (std::holds_alternative<std::string_view>(row[column])) {
+            row[column] = toCell(toCellView(row[column]));
+        }
+    }
+
+    return row;
+}
+
+const CSVRow& CSVFile::getRowRef(int index) const {
+    requireRows();
+
+    return m_rows[normalizeRow(index)];
+}
+
+CSVRowView CSVFile::getRowView(int index) const {
+    return CSVRowView{*this, normalizeRow(index)};
+}
+
+CSVColumn CSVFile::getColumn(int index) const {
+    if (m_storage != CSVStorage::Rows) {
+        return CSVColumn(getColumnView(index));
+    }
+
+    return CSVColumn(m_rows, index, m_schema.maxFields());
+}
+
+CSVColumnView CSVFile::getColumnView(int index) const {
+    return CSVColumnView{*this, normalizeColumn(index)};
+}
+
+Cell CSVFile::getCell(int row, int column) const {
+    if (m_storage != CSVStorage::Rows) {
+        return toCell(getCellView(row, column));
+    }
+
+    return toCell(toCellView(getCellRef(row, column)));
+}
+
+const Cell& CSVFile::getCellRef(int row, int column) const {
+    const CSVRow &csvRow = getRowRef(row);
+
+    if (column < 0) {
+        column = csvRow.size() + column;
+    }
+
+    if (column >= static_cast<int>(csvRow.size())) {
+        throw IndexError{"IndexError: column number too big!"};
+    }
+    else if (column < 0) {
+        throw IndexError{"IndexError: column number too small!"};
+    }
+
+    return csvRow[column];
+}
+
+CellView CSVFile::getCellView(int row, int column) const {
+    return getRowView(row).at(column);
+}
+
+CSVStats CSVFile::aggregate(int column, CSVStringPolicy policy,
+                            int threads) const
+{
+    column = normalizeColumn(column);
+
+    // the schema already knows whether there are strings to deal with
+    size_t strings = getSchema().stringCount(column);
+
+    if (policy == CSVStringPolicy::Throw && strings > 0) {
+        throw TypeError{"TypeError: column holds strings!"};
+    }
+
+    size_t rows = size();
+
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<size_t>(1, std::min<size_t>(threads,
+                                   rows / sc_minAggregateRows));
+
+    CSVStats stats{};
+
+    if (threads == 1) {
+        stats = aggregateRows(column, 0, rows);
+    }
+    else {
+        // ranges start on a multiple of 64 rows, so each thread has whole
+        // words of the number bitmaps to itself
+        std::vector<CSVStats> parts(threads);
+        std::vector<std::thread> workers{};
+
+        for (int part = 0; part < threads; ++part) {
+            size_t begin = (rows * part / threads) & ~size_t{63};
+            size_t end = (part + 1 == threads)
+                         ? rows
+                         : (rows * (part + 1) / threads) & ~size_t{63};
+
+            workers.emplace_back([&, part, begin, end]() {
+                parts[part] = aggregateRows(column, begin, end);
+            });
+        }
+
+        for (int part = 0; part < threads; ++part) {
+            workers[part].join();
+            stats.merge(parts[part]);
+        }
+    }
+
+    applyStringPolicy(stats, strings, policy);
+
+    return stats;
+}
+
+CompactCell CSVFile::getCompactCell(int row, int column) const {
+    if (m_storage != CSVStorage::Compact) {
+        throw StorageError{"StorageError: cells are not stored compactly!"};
+    }
+
+    row = normalizeRow(row);
+    int fieldCount = rowSize(row);
+
+    if (column < 0) {
+        column = fieldCount + column;
+    }
+
+    if (column >= fieldCount) {
+        throw IndexError{"IndexError: column number too big!"};
+    }
+    else if (column < 0) {
+        throw IndexError{"IndexError: column number too small!"};
+    }
+
+    return m_cells[m_rowStarts[row] + column];
+}
+
+const CSVStringPool& CSVFile::getStringPool() const {
+    return m_pool;
+}
+
+void CSVFile::hashSource(uint64_t &size, uint64_t &hash1,
+                         uint64_t &hash2) const
+{
+    CSVSnapshot::hashFile(m_filePath, size, hash1, hash2);
+
+    // the same bytes parse differently in another dialect, so its
+    // snapshots must not pass for ours
+    if (!m_dialect.isDefault()) {
+        hash2 ^= (static_cast<uint64_t>(m_dialect.delimiter) << 1 |
+                  m_dialect.quoting) * 0x9e3779b97f4a7c15ULL;
+    }
+}
+
+void CSVFile::saveSnapshot(const std::string &snapshotPath) const {
+    uint64_t sourceSize, sourceHash1, sourceHash2;
+
+    hashSource(sourceSize, sourceHash1, sourceHash2);
+    CSVSnapshot::write(*this, snapshotPath, sourceSize, sourceHash1,
+                       sourceHash2);
+}
+
+std::ostream& CSVFile::print(std::ostream& out) const {
+    CSVWriter writer{out};
+
+    writer.writeFile(*this);
+    writer.flush();
 
     return out;
 }
@@ -0,0 +1,317 @@
+//============================================================================
+// Name        : CSVGroupBy.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Grouping the rows of a CSVFile by the values in some
+//               columns, and aggregating other columns for each group.
+//============================================================================
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include "CSVGroupBy.h"
+#include "CSVIndex.h"
+
+
+CSVGroupBy::CSVGroupBy(const CSVFile &file, std::vector<int> keyColumns,
+                       std::vector<int> valueColumns,
+                       CSVStringPolicy policy, int threads,
+                       size_t minThreadRows)
+    : m_file{&file}, m_policy{policy}
+{
+    for (int column : keyColumns) {
+        m_keyColumns.push_back(file.getColumnView(column).index());
+    }
+
+    for (int column : valueColumns) {
+        m_values.push_back(file.getColumnView(column));
+
+        if (policy == CSVStringPolicy::Throw &&
+            file.getSchema().stringCount(m_values.back().index()) > 0)
+        {
+            throw TypeError{"TypeError: column holds strings!"};
+        }
+    }
+
+    int rows = file.size();
+
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    minThreadRows = std::max<size_t>(1, minThreadRows);
+    threads = std::max<size_t>(1, std::min<size_t>(threads,
+                                   rows / minThreadRows));
+
+    if (threads == 1) {
+        groupRows(m_table, 0, rows);
+        return;
+    }
+
+    std::vector<Table> tables(threads);
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> workers{};
+
+    for (int part = 0; part < threads; ++part) {
+        int begin = static_cast<long>(rows) * part / threads;
+        int end = static_cast<long>(rows) * (part + 1) / threads;
+
+        workers.emplace_back([&, part, begin, end]() {
+            try {
+                groupRows(tables[part], begin, end);
+            }
+            catch (...) {
+                errors[part] = std::current_exception();
+            }
+        });
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for (std::exception_ptr &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // the first range's groups come first, so merging the rest in order
+    // keeps the groups in order of appearance
+    m_table = std::move(tables[0]);
+    for (int part = 1; part < threads; ++part) {
+        mergeTable(tables[part]);
+    }
+}
+
+// The hash of a row's key, given the hash of its first key cell.  The rest
+// of the cells are chained on with the hash so far as their seed.
+uint64_t CSVGroupBy::keyHash(const CSVRowView &row,
+                             uint64_t firstHash) const
+{
+    uint64_t hash = firstHash;
+
+    for (size_t key = 1; key < m_keyColumns.size(); ++key) {
+        hash = CSVIndex::hash(row[m_keyColumns[key]], hash);
+    }
+
+    return hash;
+}
+
+bool CSVGroupBy::sameKey(const CSVRowView &row, int otherRow) const {
+    CSVRowView other = m_file->getRowView(otherRow);
+
+    for (int column : m_keyColumns) {
+        if (row[column] != other[column]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int CSVGroupBy::findGroup(const Table &table, uint64_t hash,
+                          const CSVRowView &row) const
+{
+    if (table.slots.empty()) {
+        return -1;
+    }
+
+    size_t index = hash & table.mask;
+
+    while (table.slots[index].group != 0) {
+        const Slot &slot = table.slots[index];
+
+        if (slot.hash == hash &&
+            sameKey(row, table.firstRows[slot.group - 1]))
+        {
+            return slot.group - 1;
+        }
+        index = (index + 1) & table.mask;
+    }
+
+    return -1;
+}
+
+void CSVGroupBy::grow(Table &table) const {
+    size_t capacity = std::max(sc_initialSlots, table.slots.size() * 2);
+
+    table.slots.assign(capacity, Slot{0, 0});
+    table.mask = capacity - 1;
+
+    for (size_t group = 0; group < table.hashes.size(); ++group) {
+        size_t index = table.hashes[group] & table.mask;
+
+        while (table.slots[index].group != 0) {
+            index = (index + 1) & table.mask;
+        }
+        table.slots[index] = Slot{table.hashes[group],
+                                  static_cast<uint32_t>(group + 1)};
+    }
+}
+
+int CSVGroupBy::addGroup(Table &table, uint64_t hash, int row) const {
+    int group = table.firstRows.size();
+
+    // keep the table at most half full
+    if (2 * (table.hashes.size() + 1) > table.slots.size()) {
+        grow(table);
+    }
+
+    size_t index = hash & table.mask;
+
+    while (table.slots[index].group != 0) {
+        index = (index + 1) & table.mask;
+    }
+    table.slots[index] = Slot{hash, static_cast<uint32_t>(group + 1)};
+
+    table.hashes.push_back(hash);
+    table.firstRows.push_back(row);
+    table.rowCounts.push_back(0);
+    table.stats.resize(table.stats.size() + m_values.size());
+
+    return group;
+}
+
+void CSVGroupBy::groupRows(Table &table, int begin, int end) const {
+    size_t values = m_values.size();
+    CellView firstKeys[sc_hashBatch];
+    uint64_t firstHashes[sc_hashBatch] = {};
+
+    for (int row = begin; row < end; ++row) {
+        int batchIndex = (row - begin) % sc_hashBatch;
+
+        // the first key cells of the next batch of rows are hashed together
+        if (batchIndex == 0 && !m_keyColumns.empty()) {
+            int count = std::min(end - row, sc_hashBatch);
+
+            for (int i = 0; i < count; ++i) {
+                firstKeys[i] = m_file->getRowView(row + i)[m_keyColumns[0]];
+            }
+            CSVIndex::hash(firstKeys, count, firstHashes);
+        }
+
+        CSVRowView rowView = m_file->getRowView(row);
+        uint64_t hash = keyHash(rowView, firstHashes[batchIndex]);
+        int group = findGroup(table, hash, rowView);
+
+        if (group < 0) {
+            group = addGroup(table, hash, row);
+        }
+
+        ++table.rowCounts[group];
+
+        CSVStats *stats = table.stats.data() + group * values;
+
+        for (size_t value = 0; value < values; ++value) {
+            const CSVColumnView &column = m_values[value];
+
+            // straight from the contiguous numbers if the storage has them
+            if (column.numbers() != nullptr &&
+                (column.numberBits()[row / 64] >> (row % 64)) & 1)
+            {
+                stats[value].add(column.numbers()[row]);
+                continue;
+            }
+
+            CellView cell = rowView[column.index()];
+
+            if (std::holds_alternative<double>(cell)) {
+                stats[value].add(std::get<double>(cell));
+            }
+            else if (m_policy == CSVStringPolicy::Zero &&
+                     !std::get<std::string_view>(cell).empty())
+            {
+                stats[value].add(0.0);
+            }
+        }
+    }
+}
+
+void CSVGroupBy::mergeTable(const Table &other) {
+    size_t values = m_values.size();
+
+    for (size_t otherGroup = 0; otherGroup < other.firstRows.size();
+         ++otherGroup)
+    {
+        uint64_t hash = other.hashes[otherGroup];
+        int row = other.firstRows[otherGroup];
+        int group = findGroup(m_table, hash, m_file->getRowView(row));
+
+        if (group < 0) {
+            group = addGroup(m_table, hash, row);
+        }
+
+        m_table.rowCounts[group] += other.rowCounts[otherGroup];
+
+        for (size_t value = 0; value < values; ++value) {
+            m_table.stats[group * values + value].merge(
+                other.stats[otherGroup * values + value]);
+        }
+    }
+}
+
+int CSVGroupBy::findGroup(const std::vector<CellView> &key) const {
+    if (key.size() != m_keyColumns.size() || m_table.slots.empty()) {
+        return -1;
+    }
+
+    uint64_t hash = 0;
+
+    for (CellView cell : key) {
+        hash = CSVIndex::hash(cell, hash);
+    }
+
+    size_t index = hash & m_table.mask;
+
+    while (m_table.slots[index].group != 0) {
+        const Slot &slot = m_table.slots[index];
+        int group = slot.group - 1;
+
+        if (slot.hash == hash) {
+            size_t keyIndex = 0;
+
+            while (keyIndex < key.size() &&
+                   this->key(group, keyIndex) == key[keyIndex]) {
+                ++keyIndex;
+            }
+
+            if (keyIndex == key.size()) {
+                return group;
+            }
+        }
+        index = (index + 1) & m_table.mask;
+    }
+
+    return -1;
+}
+
+std::ostream& CSVGroupBy::print(std::ostream& out) const {
+    size_t values = m_values.size();
+
+    out << "(";
+    for (int group = 0; group < size(); ++group) {
+        if (group > 0) {
+            out << ", ";
+        }
+
+        out << "((";
+        for (size_t keyIndex = 0; keyIndex < m_keyColumns.size();
+             ++keyIndex) {
+            if (keyIndex > 0) {
+                out << ", ";
+            }
+            std::visit(CellPrint{out}, key(group, keyIndex));
+        }
+        out << "), " << rows(group);
+
+        for (size_t value = 0; value < values; ++value) {
+            out << ", " << stats(group, value);
+        }
+        out << ")";
+    }
+    out << ")";
+
+    return out;
+}
@@ -0,0 +1,247 @@
+//============================================================================
+// Name        : CSVIndex.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : A hash index on one column of a CSVFile, for finding rows
+//               by their value in that column.
+//============================================================================
+
+#include <algorithm>
+#include <cstring>
+
+#include "CSVIndex.h"
+#include "SpookyV2.h"
+
+
+// different seeds, so a number and a string with the same bytes do not
+// land in the same slot
+static const uint64 sc_numberSeed = 0x6e756d626572ULL;
+static const uint64 sc_stringSeed = 0x737472696e67ULL;
+
+
+CSVIndex::CSVIndex(const CSVFile &file, int column)
+    : m_file{&file}, m_column{file.getColumnView(column).index()}
+{
+    int rows = file.size();
+
+    grow();
+
+    // First find each row's key, numbering the keys as they first appear
+    // and counting their rows.  Until we have the counts, a slot's start
+    // is its key's number.
+    std::vector<uint32_t> rowKeys(rows);
+    std::vector<uint32_t> firstRows{};
+    CellView keys[sc_hashBatch];
+    uint64_t hashes[sc_hashBatch];
+
+    for (int batch = 0; batch < rows; batch += sc_hashBatch) {
+        int count = std::min<int>(rows - batch, sc_hashBatch);
+
+        for (int i = 0; i < count; ++i) {
+            keys[i] = key(batch + i);
+        }
+        hash(keys, count, hashes);
+
+        for (int i = 0; i < count; ++i) {
+            int row = batch + i;
+            size_t index = hashes[i] & m_mask;
+
+            while (m_slots[index].count > 0) {
+                const Slot &slot = m_slots[index];
+
+                if (slot.hash == hashes[i] &&
+                    key(firstRows[slot.start]) == keys[i])
+                {
+                    break;
+                }
+                index = (index + 1) & m_mask;
+            }
+
+            if (m_slots[index].count == 0) {
+                // keep the table at most half full
+                if (2 * (m_keys + 1) > m_slots.size()) {
+                    grow();
+                    index = hashes[i] & m_mask;
+
+                    while (m_slots[index].count > 0) {
+                        index = (index + 1) & m_mask;
+                    }
+                }
+
+                m_slots[index] = Slot{hashes[i],
+                                      static_cast<uint32_t>(m_keys), 0};
+                firstRows.push_back(row);
+                ++m_keys;
+            }
+            ++m_slots[index].count;
+            rowKeys[row] = m_slots[index].start;
+        }
+    }
+
+    // then give each key its own run of m_rows, in the order the keys
+    // first appear
+    std::vector<uint32_t> next(m_keys);
+
+    for (const Slot &slot : m_slots) {
+        if (slot.count > 0) {
+            next[slot.start] = slot.count;
+        }
+    }
+
+    uint32_t start = 0;
+
+    for (uint32_t &keyStart : next) {
+        uint32_t count = keyStart;
+
+        keyStart = start;
+        start += count;
+    }
+
+    for (Slot &slot : m_slots) {
+        if (slot.count > 0) {
+            slot.start = next[slot.start];
+        }
+    }
+
+    m_rows.resize(rows);
+    for (int row = 0; row < rows; ++row) {
+        m_rows[next[rowKeys[row]]++] = row;
+    }
+}
+
+void CSVIndex::grow() {
+    size_t capacity = std::max(sc_initialSlots, m_slots.size() * 2);
+    std::vector<Slot> slots(capacity, Slot{0, 0, 0});
+
+    m_mask = capacity - 1;
+
+    for (const Slot &slot : m_slots) {
+        if (slot.count > 0) {
+            size_t index = slot.hash & m_mask;
+
+            while (slots[index].count > 0) {
+                index = (index + 1) & m_mask;
+            }
+            slots[index] = slot;
+        }
+    }
+
+    m_slots.swap(slots);
+}
+
+CellView CSVIndex::key(int row) const {
+    return m_file->getRowView(row)[m_column];
+}
+
+uint64_t CSVIndex::hash(CellView key, uint64_t seed) {
+    if (std::holds_alternative<double>(key)) {
+        double number = std::get<double>(key);
+        uint64_t bits;
+
+        if (number == 0.0) {
+            number = 0.0;  // -0.0 is equal to 0.0, so it has to hash alike
+        }
+        std::memcpy(&bits, &number, sizeof(bits));
+
+        return SpookyHash::Hash64(&bits, sizeof(bits), seed ^ sc_numberSeed);
+    }
+
+    std::string_view str = std::get<std::string_view>(key);
+
+    return SpookyHash::Hash64(str.data(), str.size(), seed ^ sc_stringSeed);
+}
+
+void CSVIndex::hash(const CellView *keys, size_t count, uint64_t *hashes,
+                    uint64_t seed)
+{
+    // numbers and strings have their own seeds, so they are batched apart
+    const void *strings[sc_hashBatch];
+    size_t stringLengths[sc_hashBatch];
+    size_t stringKeys[sc_hashBatch];
+    uint64_t stringHashes[sc_hashBatch];
+
+    uint64_t numberBits[sc_hashBatch];
+    const void *numbers[sc_hashBatch];
+    size_t numberLengths[sc_hashBatch];
+    size_t numberKeys[sc_hashBatch];
+    uint64_t numberHashes[sc_hashBatch];
+
+    for (size_t start = 0; start < count; start += sc_hashBatch) {
+        size_t end = std::min(count, start + sc_hashBatch);
+        size_t stringCount = 0, numberCount = 0;
+
+        for (size_t i = start; i < end; ++i) {
+            if (std::holds_alternative<double>(keys[i])) {
+                double number = std::get<double>(keys[i]);
+
+                if (number == 0.0) {
+                    number = 0.0;
+                }
+                std::memcpy(&numberBits[numberCount], &number,
+                            sizeof(number));
+                numbers[numberCount] = &numberBits[numberCount];
+                numberLengths[numberCount] = sizeof(number);
+                numberKeys[numberCount++] = i;
+            }
+            else {
+                std::string_view str = std::get<std::string_view>(keys[i]);
+
+                strings[stringCount] = str.data();
+                stringLengths[stringCount] = str.size();
+                stringKeys[stringCount++] = i;
+            }
+        }
+
+        SpookyHash::Hash64Batch(strings, stringLengths, stringCount,
+                                seed ^ sc_stringSeed, stringHashes);
+        SpookyHash::Hash64Batch(numbers, numberLengths, numberCount,
+                                seed ^ sc_numberSeed, numberHashes);
+
+        for (size_t i = 0; i < stringCount; ++i) {
+            hashes[stringKeys[i]] = stringHashes[i];
+        }
+        for (size_t i = 0; i < numberCount; ++i) {
+            hashes[numberKeys[i]] = numberHashes[i];
+        }
+    }
+}
+
+const CSVIndex::Slot* CSVIndex::find(CellView key) const {
+    uint64_t keyHash = hash(key);
+    size_t index = keyHash & m_mask;
+
+    while (m_slots[index].count > 0) {
+        const Slot &slot = m_slots[index];
+
+        if (slot.hash == keyHash && this->key(m_rows[slot.start]) == key) {
+            return &slot;
+        }
+        index = (index + 1) & m_mask;
+    }
+
+    return nullptr;
+}
+
+int CSVIndex::findRow(CellView key) const {
+    const Slot *slot = find(key);
+
+    return (slot == nullptr) ? -1 : m_rows[slot->start];
+}
+
+std::vector<int> CSVIndex::findRows(CellView key) const {
+    const Slot *slot = find(key);
+
+    if (slot == nullptr) {
+        return std::vector<int>{};
+    }
+
+    return std::vector<int>(m_rows.begin() + slot->start,
+                            m_rows.begin() + slot->start + slot->count);
+}
+
+int CSVIndex::count(CellView key) const {
+    const Slot *slot = find(key);
+
+    return (slot == nullptr) ? 0 : slot->count;
+}
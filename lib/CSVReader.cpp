@@ -0,0 +1,115 @@
+//============================================================================
+// Name        : CSVReader.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Single pass, row at a time reading of a CSV file
+//               (comma separated values)
+//============================================================================
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include "CSVReader.h"
+
+
+CSVReader::CSVReader(std::string filePath, size_t bufferSize,
+                     CSVDialect dialect)
+    : m_buffer(std::max<size_t>(bufferSize, 1)), m_dialect{dialect},
+      m_scanner{dialect.delimiter, dialect.quoting}
+{
+    if (CompressedFile::detect(filePath) != Compression::None) {
+        m_compressed = std::make_unique<CompressedFile>(filePath);
+    }
+    else {
+        m_readAhead = std::make_unique<ReadAheadFile>(filePath);
+    }
+}
+
+CSVReader::CSVReader(std::istream &in, size_t bufferSize,
+                     CSVDialect dialect)
+    : m_in{&in}, m_buffer(std::max<size_t>(bufferSize, 1)),
+      m_dialect{dialect}, m_scanner{dialect.delimiter, dialect.quoting}
+{}
+
+bool CSVReader::fill() {
+    if (m_eof) {
+        return false;
+    }
+
+    // keep the partial line we have, and make room behind it
+    if (m_start > 0) {
+        std::memmove(m_buffer.data(), m_buffer.data() + m_start,
+                     m_end - m_start);
+        m_end -= m_start;
+        m_start = 0;
+    }
+
+    if (m_end == m_buffer.size()) {
+        // a line longer than the whole buffer
+        m_buffer.resize(m_buffer.size() * 2);
+    }
+
+    size_t room = m_buffer.size() - m_end;
+
+    if (m_compressed || m_readAhead) {
+        size_t got = m_compressed
+                     ? m_compressed->read(m_buffer.data() + m_end, room)
+                     : m_readAhead->read(m_buffer.data() + m_end, room);
+
+        m_end += got;
+        m_eof = (got < room);
+        return true;
+    }
+
+    m_in->read(m_buffer.data() + m_end, room);
+    m_end += m_in->gcount();
+
+    if (!*m_in) {
+        m_eof = true;
+    }
+
+    return true;
+}
+
+bool CSVReader::readRow(CSVRow &row) {
+    while (true) {
+        const char *start = m_buffer.data() + m_start;
+        size_t newline = m_scanner.findNewline(
+            std::string_view{start + m_searched,
+                             m_end - m_start - m_searched},
+            m_lineState);
+
+        size_t lineLength;
+
+        if (newline != std::string_view::npos) {
+            lineLength = m_searched + newline;
+            m_searched = 0;
+        }
+        else {
+            // carry on from here once there is more
+            m_searched = m_end - m_start;
+
+            if (fill()) {
+                continue;
+            }
+            else if (m_end == m_start) {
+                return false;
+            }
+
+            lineLength = m_end - m_start;  // last line, no newline
+            m_searched = 0;
+            m_lineState = CSVScanner::LineState{};
+        }
+
+        m_start += lineLength + (newline != std::string_view::npos ? 1 : 0);
+
+        if (lineLength > 0) {
+            row = CSVRow{std::string_view{start, lineLength}, false, nullptr,
+                         &m_dialect};
+            ++m_rowNumber;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,457 @@
+//============================================================================
+// Name        : CSVScanner.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Vectorized search for field and line separators in
+//               delimited text.
+//============================================================================
+
+#include <algorithm>
+
+#include "CSVScanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSVSCANNER_X86 1
+#endif
+
+
+static void scanTail(const char *data, size_t i, size_t length,
+                     char delimiter, std::vector<uint32_t> &separators)
+{
+    for (; i < length; ++i) {
+        if (data[i] == delimiter || data[i] == '\n') {
+            separators.push_back(i);
+        }
+    }
+}
+
+static void scanScalar(const char *data, size_t length, char delimiter,
+                       std::vector<uint32_t> &separators)
+{
+    scanTail(data, 0, length, delimiter, separators);
+}
+
+// A quote only opens quotes at the start of a field, or straight after
+// the quote that closed them, as the first of a doubled pair; anywhere
+// else it is part of the text, like the inch mark in 5" pipe.
+static void scanQuotedTail(const char *data, size_t i, size_t length,
+                           char delimiter, bool &inQuotes, bool &canQuote,
+                           std::vector<uint32_t> &separators)
+{
+    for (; i < length; ++i) {
+        if (data[i] == '"') {
+            if (inQuotes) {
+                inQuotes = false;
+                canQuote = true;
+            }
+            else if (canQuote) {
+                inQuotes = true;
+            }
+        }
+        else if (inQuotes) {
+            continue;
+        }
+        else if (data[i] == delimiter || data[i] == '\n') {
+            separators.push_back(i);
+            canQuote = true;
+        }
+        else {
+            canQuote = false;
+        }
+    }
+}
+
+static void scanQuotedScalar(const char *data, size_t length,
+                             char delimiter,
+                             std::vector<uint32_t> &separators)
+{
+    bool inQuotes = false, canQuote = true;
+
+    scanQuotedTail(data, 0, length, delimiter, inQuotes, canQuote,
+                   separators);
+}
+
+
+#ifdef CSVSCANNER_X86
+
+// append the offset of every set bit in mask
+static inline void pushMask(uint32_t mask, size_t base,
+                            std::vector<uint32_t> &separators)
+{
+    while (mask != 0) {
+        separators.push_back(base + __builtin_ctz(mask));
+        mask &= mask - 1;
+    }
+}
+
+// scans 16 bytes at a time from i, returning where it stopped
+__attribute__((target("sse2")))
+static size_t scan16(const char *data, size_t i, size_t length,
+                     char delimiter, std::vector<uint32_t> &separators)
+{
+    const __m128i delimiters = _mm_set1_epi8(delimiter);
+    const __m128i newlines = _mm_set1_epi8('\n');
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(data + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, delimiters),
+                                    _mm_cmpeq_epi8(chunk, newlines));
+
+        pushMask(_mm_movemask_epi8(hits), i, separators);
+    }
+
+    return i;
+}
+
+__attribute__((target("sse2")))
+static void scanSSE2(const char *data, size_t length, char delimiter,
+                     std::vector<uint32_t> &separators)
+{
+    size_t i = scan16(data, 0, length, delimiter, separators);
+
+    scanTail(data, i, length, delimiter, separators);
+}
+
+__attribute__((target("avx2")))
+static void scanAVX2(const char *data, size_t length, char delimiter,
+                     std::vector<uint32_t> &separators)
+{
+    const __m256i delimiters = _mm256_set1_epi8(delimiter);
+    const __m256i newlines = _mm256_set1_epi8('\n');
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + i));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, delimiters),
+                                       _mm256_cmpeq_epi8(chunk, newlines));
+
+        pushMask(_mm256_movemask_epi8(hits), i, separators);
+    }
+
+    i = scan16(data, i, length, delimiter, separators);
+    scanTail(data, i, length, delimiter, separators);
+}
+
+// append the offset of every set bit in mask
+static inline void pushMask64(uint64_t mask, size_t base,
+                              std::vector<uint32_t> &separators)
+{
+    while (mask != 0) {
+        separators.push_back(base + __builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+}
+
+// Bit i of the result is the XOR of bits 0 to i: set from each opening
+// quote up to, but not including, its closing one.
+static inline uint64_t prefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// the same, as one carry-less multiply by all ones
+__attribute__((target("sse2,pclmul")))
+static inline uint64_t prefixXorClmul(uint64_t bits) {
+    __m128i product = _mm_clmulepi64_si128(
+        _mm_set_epi64x(0, bits), _mm_set1_epi8(static_cast<char>(0xff)), 0);
+
+    return _mm_cvtsi128_si64(product);
+}
+
+// The prefix XOR takes every quote to open or close quotes.  That is
+// right as long as each quote it takes to open them follows a separator
+// or a closing quote, as scanQuotedTail() would have it; if one does
+// not, this returns false, for the block to be done again a byte at a
+// time.  Otherwise it sets canQuote for the first byte of the next
+// block.
+static inline bool quotesOpenFields(uint64_t quoteBits,
+                                    uint64_t separatorBits,
+                                    uint64_t quoted, uint64_t &canQuote)
+{
+    uint64_t opening = quoteBits & quoted;
+    uint64_t starts = (separatorBits & ~quoted) | (quoteBits & ~quoted);
+
+    if ((opening & ~((starts << 1) | canQuote)) != 0) {
+        return false;
+    }
+
+    canQuote = starts >> 63;
+    return true;
+}
+
+// does a block of 64 bytes a byte at a time, carrying the state in and
+// out as the vector loops keep it
+static void scanQuotedBlock(const char *data, size_t i, char delimiter,
+                            uint64_t &inQuotes, uint64_t &canQuote,
+                            std::vector<uint32_t> &separators)
+{
+    bool blockInQuotes = (inQuotes != 0), blockCanQuote = (canQuote != 0);
+
+    scanQuotedTail(data, i, i + 64, delimiter, blockInQuotes, blockCanQuote,
+                   separators);
+    inQuotes = blockInQuotes ? ~uint64_t{0} : 0;
+    canQuote = blockCanQuote ? 1 : 0;
+}
+
+__attribute__((target("sse2")))
+static void scanQuotedSSE2(const char *data, size_t length, char delimiter,
+                           std::vector<uint32_t> &separators)
+{
+    const __m128i delimiters = _mm_set1_epi8(delimiter);
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i quotes = _mm_set1_epi8('"');
+    uint64_t inQuotes = 0;   // all ones while inside quotes
+    uint64_t canQuote = 1;   // whether a quote opens quotes at i
+    size_t i = 0;
+
+    for (; i + 64 <= length; i += 64) {
+        uint64_t separatorBits = 0, quoteBits = 0;
+
+        for (int part = 0; part < 4; ++part) {
+            __m128i chunk = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + i + 16 * part));
+            __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, delimiters),
+                                        _mm_cmpeq_epi8(chunk, newlines));
+
+            separatorBits |= static_cast<uint64_t>(static_cast<uint16_t>(
+                _mm_movemask_epi8(hits))) << (16 * part);
+            quoteBits |= static_cast<uint64_t>(static_cast<uint16_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quotes))))
+                << (16 * part);
+        }
+
+        uint64_t quoted = prefixXor(quoteBits) ^ inQuotes;
+
+        if (!quotesOpenFields(quoteBits, separatorBits, quoted, canQuote)) {
+            scanQuotedBlock(data, i, delimiter, inQuotes, canQuote,
+                            separators);
+            continue;
+        }
+
+        // carry the state of the last byte on to the next block
+        inQuotes = static_cast<uint64_t>(static_cast<int64_t>(quoted) >> 63);
+        pushMask64(separatorBits & ~quoted, i, separators);
+    }
+
+    bool tailInQuotes = (inQuotes != 0), tailCanQuote = (canQuote != 0);
+
+    scanQuotedTail(data, i, length, delimiter, tailInQuotes, tailCanQuote,
+                   separators);
+}
+
+__attribute__((target("avx2,pclmul")))
+static void scanQuotedAVX2(const char *data, size_t length, char delimiter,
+                           std::vector<uint32_t> &separators)
+{
+    const __m256i delimiters = _mm256_set1_epi8(delimiter);
+    const __m256i newlines = _mm256_set1_epi8('\n');
+    const __m256i quotes = _mm256_set1_epi8('"');
+    uint64_t inQuotes = 0;
+    uint64_t canQuote = 1;
+    size_t i = 0;
+
+    for (; i + 64 <= length; i += 64) {
+        __m256i low = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + i));
+        __m256i high = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + i + 32));
+
+        uint64_t separatorBits =
+            static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(low, delimiters),
+                                _mm256_cmpeq_epi8(low, newlines)))) |
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(high, delimiters),
+                                _mm256_cmpeq_epi8(high, newlines))))) << 32;
+        uint64_t quoteBits =
+            static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(low, quotes))) |
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(high, quotes)))) << 32;
+
+        uint64_t quoted = prefixXorClmul(quoteBits) ^ inQuotes;
+
+        if (!quotesOpenFields(quoteBits, separatorBits, quoted, canQuote)) {
+            scanQuotedBlock(data, i, delimiter, inQuotes, canQuote,
+                            separators);
+            continue;
+        }
+
+        inQuotes = static_cast<uint64_t>(static_cast<int64_t>(quoted) >> 63);
+        pushMask64(separatorBits & ~quoted, i, separators);
+    }
+
+    bool tailInQuotes = (inQuotes != 0), tailCanQuote = (canQuote != 0);
+
+    scanQuotedTail(data, i, length, delimiter, tailInQuotes, tailCanQuote,
+                   separators);
+}
+
+#endif // CSVSCANNER_X86
+
+
+CSVScanner::CSVScanner(char delimiter, bool quoting)
+    : CSVScanner(delimiter, quoting, best())
+{}
+
+CSVScanner::CSVScanner(char delimiter, Impl impl)
+    : CSVScanner(delimiter, false, impl)
+{}
+
+CSVScanner::CSVScanner(char delimiter, bool quoting, Impl impl)
+    : m_delimiter{delimiter}, m_quoting{quoting}, m_impl{impl}
+{
+    switch (m_impl) {
+#ifdef CSVSCANNER_X86
+    case Impl::AVX2:
+        if (!quoting) {
+            m_scan = scanAVX2;
+        }
+        else if (__builtin_cpu_supports("pclmul")) {
+            m_scan = scanQuotedAVX2;
+        }
+        else {
+            m_scan = scanQuotedSSE2;
+        }
+        break;
+    case Impl::SSE2:
+        m_scan = quoting ? scanQuotedSSE2 : scanSSE2;
+        break;
+#endif
+    default:
+        m_impl = Impl::Scalar;
+        m_scan = quoting ? scanQuotedScalar : scanScalar;
+        break;
+    }
+}
+
+// Follows text from state the way scanQuotedTail() does, skipping from
+// quote to quote with memchr(), and returns the offset of the first
+// newline outside quotes, or with last, the last one; npos if there is
+// none.  state is left as it is after the first newline, or at the end
+// of text.
+static size_t followQuotes(std::string_view text, char delimiter,
+                           CSVScanner::LineState &state, bool last)
+{
+    const char *data = text.data();
+    size_t length = text.length();
+    size_t found = std::string_view::npos;
+    size_t closed = std::string_view::npos;   // just past a closing quote
+    size_t i = 0;
+
+    while (i < length) {
+        const char *quote = static_cast<const char*>(
+            std::memchr(data + i, '"', length - i));
+        size_t end = (quote != nullptr) ? quote - data : length;
+
+        if (state.inQuotes) {
+            if (quote == nullptr) {
+                break;
+            }
+            state.inQuotes = false;
+            closed = i = end + 1;
+            continue;
+        }
+
+        const void *newline = last
+            ? ::memrchr(data + i, '\n', end - i)
+            : std::memchr(data + i, '\n', end - i);
+
+        if (newline != nullptr) {
+            found = static_cast<const char*>(newline) - data;
+
+            if (!last) {
+                state = CSVScanner::LineState{};
+                return found;
+            }
+        }
+
+        if (quote == nullptr) {
+            break;
+        }
+
+        if (end == 0) {
+            state.inQuotes = state.canQuote;
+        }
+        else {
+            state.inQuotes = (data[end - 1] == delimiter ||
+                              data[end - 1] == '\n' || closed == end);
+        }
+        i = end + 1;
+    }
+
+    if (length > 0 && !state.inQuotes) {
+        state.canQuote = (data[length - 1] == delimiter ||
+                          data[length - 1] == '\n' || closed == length);
+    }
+
+    return found;
+}
+
+size_t CSVScanner::findNewline(std::string_view text, size_t from) const {
+    if (!m_quoting) {
+        return text.find('\n', from);
+    }
+
+    LineState state{};
+
+    from = std::min(from, text.length());
+
+    // the state at from, which may be inside quotes
+    followQuotes(text.substr(0, from), m_delimiter, state, true);
+
+    size_t newline = findNewline(text.substr(from), state);
+
+    return (newline == std::string_view::npos) ? newline : from + newline;
+}
+
+size_t CSVScanner::findNewline(std::string_view text,
+                               LineState &state) const
+{
+    if (!m_quoting) {
+        return text.find('\n');
+    }
+
+    return followQuotes(text, m_delimiter, state, false);
+}
+
+size_t CSVScanner::findLastNewline(std::string_view text) const {
+    if (!m_quoting) {
+        return text.rfind('\n');
+    }
+
+    LineState state{};
+
+    return followQuotes(text, m_delimiter, state, true);
+}
+
+CSVScanner::Impl CSVScanner::best() {
+#ifdef CSVSCANNER_X86
+    static const Impl impl = __builtin_cpu_supports("avx2") ? Impl::AVX2
+                           : __builtin_cpu_supports("sse2") ? Impl::SSE2
+                           : Impl::Scalar;
+    return impl;
+#else
+    return Impl::Scalar;
+#endif
+}
+
+const char* CSVScanner::name(Impl impl) {
+    switch (impl) {
+    case Impl::AVX2:
+        return "avx2";
+    case Impl::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,255 @@
+//============================================================================
+// Name        : CSVSnapshot.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : A binary, columnar snapshot of a parsed CSVFile that can be
+//               memory mapped back in without parsing anything.
+//============================================================================
+
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <unistd.h>
+
+#include "CSVSnapshot.h"
+#include "SpookyV2.h"
+
+
+CSVSnapshot::CSVSnapshot(const std::string &snapshotPath)
+    : m_mapping{snapshotPath}
+{
+    const char *data = m_mapping.data();
+    size_t size = m_mapping.size();
+
+    if (size < sizeof(Header)) {
+        throw StorageError{"StorageError: snapshot is too short!"};
+    }
+
+    std::memcpy(&m_header, data, sizeof(Header));
+
+    if (std::memcmp(m_header.magic, sc_magic, sizeof(sc_magic)) != 0) {
+        throw StorageError{"StorageError: not a CSV snapshot!"};
+    }
+    else if (m_header.byteOrder != sc_byteOrder) {
+        throw StorageError{"StorageError: snapshot has the wrong byte order!"};
+    }
+    else if (m_header.version != sc_version) {
+        throw StorageError{"StorageError: unknown snapshot version!"};
+    }
+    else if (m_header.fileSize != size) {
+        throw StorageError{"StorageError: snapshot is truncated!"};
+    }
+
+    size_t rows = m_header.rows;
+    size_t columns = m_header.maxFields;
+    size_t offset = align(sizeof(Header));
+
+    if (rows > INT32_MAX || columns > INT32_MAX ||
+        m_header.minFields > m_header.maxFields)
+    {
+        throw StorageError{"StorageError: snapshot header is corrupt!"};
+    }
+
+    // Each section has to fit in what is left of the file before we point
+    // at it, checked so that a corrupt count cannot overflow the sums.
+    auto section = [&](uint64_t count, size_t elementSize) {
+        if (offset > size || count > (size - offset) / elementSize) {
+            throw StorageError{"StorageError: snapshot sections do not add "
+                               "up!"};
+        }
+
+        const char *start = data + offset;
+
+        offset += count * elementSize;
+        return start;
+    };
+
+    m_bitmapWords = (rows + 63) / 64;
+
+    m_rowSizes = reinterpret_cast<const uint32_t*>(
+        section(rows, sizeof(uint32_t)));
+    offset = align(offset);
+
+    m_counts = reinterpret_cast<const uint32_t*>(
+        section(2 * columns, sizeof(uint32_t)));
+    offset = align(offset);
+
+    uint64_t columnWords = m_bitmapWords + rows;
+
+    if (columnWords != 0 && columns > UINT64_MAX / columnWords) {
+        throw StorageError{"StorageError: snapshot sections do not add up!"};
+    }
+    m_columns = reinterpret_cast<const uint64_t*>(
+        section(columns * columnWords, sizeof(uint64_t)));
+
+    m_stringEnds = reinterpret_cast<const uint64_t*>(
+        section(m_header.strings, sizeof(uint64_t)));
+
+    m_chars = data + offset;
+
+    // the strings have to run on from each other to the end of the file
+    uint64_t end = 0;
+
+    for (uint64_t id = 0; id < m_header.strings; ++id) {
+        if (m_stringEnds[id] < end) {
+            throw StorageError{"StorageError: snapshot strings are "
+                               "corrupt!"};
+        }
+        end = m_stringEnds[id];
+    }
+
+    if (end != size - offset) {
+        throw StorageError{"StorageError: snapshot sections do not add up!"};
+    }
+
+    // a row longer than the widest would read past its columns
+    for (size_t row = 0; row < rows; ++row) {
+        if (m_rowSizes[row] > columns) {
+            throw StorageError{"StorageError: snapshot rows are corrupt!"};
+        }
+    }
+}
+
+CSVSchema CSVSnapshot::schema() const {
+    int columns = m_header.maxFields;
+
+    return CSVSchema{static_cast<int>(m_header.rows),
+                     static_cast<int>(m_header.minFields), columns,
+                     std::vector<int>(m_counts, m_counts + columns),
+                     std::vector<int>(m_counts + columns,
+                                      m_counts + 2 * columns)};
+}
+
+static void writePadding(std::ofstream &out) {
+    static const char zeros[8] = {};
+    size_t offset = out.tellp();
+
+    out.write(zeros, ((offset + 7) & ~size_t{7}) - offset);
+}
+
+void CSVSnapshot::write(const CSVFile &csvFile,
+                        const std::string &snapshotPath,
+                        uint64_t sourceSize, uint64_t sourceHash1,
+                        uint64_t sourceHash2)
+{
+    const CSVSchema &schema = csvFile.getSchema();
+    int rows = schema.rows();
+    int columns = schema.columns();
+
+    std::string tempPath = snapshotPath + "." + std::to_string(::getpid())
+                           + ".tmp";
+    std::ofstream out{tempPath, std::ios::binary | std::ios::trunc};
+
+    if (!out) {
+        throw FileError{"FileException: Could not open file for writing!"};
+    }
+
+    Header header{};
+
+    std::memcpy(header.magic, sc_magic, sizeof(sc_magic));
+    header.version = sc_version;
+    header.byteOrder = sc_byteOrder;
+    header.sourceSize = sourceSize;
+    header.sourceHash1 = sourceHash1;
+    header.sourceHash2 = sourceHash2;
+    header.rows = rows;
+    header.minFields = schema.minFields();
+    header.maxFields = columns;
+
+    // the header is written again at the end, once we know the sizes
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writePadding(out);
+
+    std::vector<uint32_t> rowSizes(rows);
+    for (int row = 0; row < rows; ++row) {
+        rowSizes[row] = csvFile.getRowView(row).size();
+    }
+    out.write(reinterpret_cast<const char*>(rowSizes.data()),
+              rows * sizeof(uint32_t));
+    writePadding(out);
+
+    std::vector<uint32_t> counts(2 * columns);
+    for (int column = 0; column < columns; ++column) {
+        counts[column] = schema.numberCount(column);
+        counts[columns + column] = schema.stringCount(column);
+    }
+    out.write(reinterpret_cast<const char*>(counts.data()),
+              counts.size() * sizeof(uint32_t));
+    writePadding(out);
+
+    CSVStringPool pool{};
+    std::vector<uint64_t> bitmap((rows + 63) / 64);
+    std::vector<uint64_t> values(rows);
+
+    for (int column = 0; column < columns; ++column) {
+        std::fill(bitmap.begin(), bitmap.end(), 0);
+        std::fill(values.begin(), values.end(), 0);
+
+        for (int row = 0; row < rows; ++row) {
+            if (column >= static_cast<int>(rowSizes[row])) {
+                continue;
+            }
+
+            CellView cell = csvFile.getRowView(row)[column];
+
+            if (std::holds_alternative<double>(cell)) {
+                double number = std::get<double>(cell);
+
+                bitmap[row / 64] |= uint64_t{1} << (row % 64);
+                std::memcpy(&values[row], &number, sizeof(number));
+            }
+            else {
+                values[row] = pool.intern(std::get<std::string_view>(cell));
+            }
+        }
+
+        out.write(reinterpret_cast<const char*>(bitmap.data()),
+                  bitmap.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(values.data()),
+                  values.size() * sizeof(uint64_t));
+    }
+
+    std::vector<uint64_t> stringEnds(pool.size());
+    uint64_t end = 0;
+
+    for (size_t id = 0; id < pool.size(); ++id) {
+        end += pool.view(id).size();
+        stringEnds[id] = end;
+    }
+    out.write(reinterpret_cast<const char*>(stringEnds.data()),
+              stringEnds.size() * sizeof(uint64_t));
+
+    for (size_t id = 0; id < pool.size(); ++id) {
+        std::string_view str = pool.view(id);
+        out.write(str.data(), str.size());
+    }
+
+    header.fileSize = out.tellp();
+    header.strings = pool.size();
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+
+    if (!out || std::rename(tempPath.c_str(), snapshotPath.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        throw FileError{"FileException: Could not write snapshot!"};
+    }
+}
+
+void CSVSnapshot::hashFile(const std::string &filePath, uint64_t &size,
+                           uint64_t &hash1, uint64_t &hash2)
+{
+    MappedFile mapping{filePath};
+
+    size = mapping.size();
+    hash1 = 0;
+    hash2 = 0;
+
+    // the tree hash spreads a large source over every core
+    SpookyHash::HashTree128(mapping.data(), size, &hash1, &hash2);
+}
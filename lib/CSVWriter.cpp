@@ -0,0 +1,341 @@
+//============================================================================
+// Name        : CSVWriter.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Fast buffered output of cells, rows and whole CSV files.
+//============================================================================
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "CSVWriter.h"
+
+
+CSVWriter::CSVWriter(const std::string &filePath, CSVFormat format,
+                     size_t bufferSize)
+    : m_buffer{new char[std::max<size_t>(bufferSize, sc_maxNumberSize)]},
+      m_capacity{std::max<size_t>(bufferSize, sc_maxNumberSize)},
+      m_format{format}
+{
+    m_fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (m_fd < 0) {
+        throw FileError{"FileException: Could not open file for writing!"};
+    }
+}
+
+CSVWriter::CSVWriter(std::ostream &out, CSVFormat format, size_t bufferSize)
+    : m_buffer{new char[std::max<size_t>(bufferSize, sc_maxNumberSize)]},
+      m_capacity{std::max<size_t>(bufferSize, sc_maxNumberSize)},
+      m_out{&out}, m_format{format}, m_precision{int(out.precision())},
+      m_numberFlags{out.flags() & (std::ios_base::floatfield |
+                                   std::ios_base::showpos |
+                                   std::ios_base::showpoint |
+                                   std::ios_base::uppercase)}
+{}
+
+CSVWriter::~CSVWriter() {
+    try {
+        close();
+    }
+    catch (const Exception &) {
+        // nowhere to report it from here
+    }
+}
+
+void CSVWriter::bulkWrite(const char *data, size_t size) {
+    // a stream keeps its own failures in its state, as usual
+    if (m_out != nullptr) {
+        m_out->write(data, size);
+        return;
+    }
+
+    while (size > 0) {
+        ssize_t written = ::write(m_fd, data, size);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw FileError{"FileException: Could not write file!"};
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+void CSVWriter::flush() {
+    if (m_used > 0) {
+        size_t used = m_used;
+
+        m_used = 0;
+        bulkWrite(m_buffer.get(), used);
+    }
+}
+
+void CSVWriter::close() {
+    if (m_fd >= 0) {
+        try {
+            flush();
+        }
+        catch (const Exception &) {
+            ::close(m_fd);
+            m_fd = -1;
+            throw;
+        }
+
+        if (::close(m_fd) != 0) {
+            m_fd = -1;
+            throw FileError{"FileException: Could not write file!"};
+        }
+        m_fd = -1;
+    }
+    else if (m_out != nullptr) {
+        flush();
+    }
+}
+
+void CSVWriter::put(std::string_view text) {
+    if (text.size() > m_capacity - m_used) {
+        flush();
+
+        // too big to be worth copying
+        if (text.size() > m_capacity) {
+            bulkWrite(text.data(), text.size());
+            return;
+        }
+    }
+
+    std::memcpy(m_buffer.get() + m_used, text.data(), text.size());
+    m_used += text.size();
+}
+
+void CSVWriter::putNumber(double number) {
+    if (m_capacity - m_used < sc_maxNumberSize) {
+        flush();
+    }
+
+    char *first = m_buffer.get() + m_used;
+    char *last = first + sc_maxNumberSize;
+    std::to_chars_result result;
+
+    if (m_format == CSVFormat::Debug && m_numberFlags) {
+        putStreamNumber(number);
+        return;
+    }
+    else if (m_format == CSVFormat::Debug) {
+        // what a std::ostream does with no floatfield set, printf's %g
+        result = std::to_chars(first, last, number,
+                               std::chars_format::general, m_precision);
+    }
+    else {
+        // the shortest that parses back to the same double
+        result = std::to_chars(first, last, number);
+    }
+
+    m_used += result.ptr - first;
+}
+
+void CSVWriter::putStreamNumber(double number) {
+    // the printf format a std::ostream builds from the same flags
+    std::ios_base::fmtflags floatField =
+        m_numberFlags & std::ios_base::floatfield;
+    bool upper = (m_numberFlags & std::ios_base::uppercase) != 0;
+    char format[8];
+    char *spec = format;
+
+    *spec++ = '%';
+    if (m_numberFlags & std::ios_base::showpos) {
+        *spec++ = '+';
+    }
+    if (m_numberFlags & std::ios_base::showpoint) {
+        *spec++ = '#';
+    }
+
+    // hexfloat, both fields set, takes no precision
+    bool hex = (floatField == std::ios_base::floatfield);
+
+    if (!hex) {
+        *spec++ = '.';
+        *spec++ = '*';
+    }
+
+    if (floatField == std::ios_base::fixed) {
+        *spec++ = upper ? 'F' : 'f';
+    }
+    else if (floatField == std::ios_base::scientific) {
+        *spec++ = upper ? 'E' : 'e';
+    }
+    else if (hex) {
+        *spec++ = upper ? 'A' : 'a';
+    }
+    else {
+        *spec++ = upper ? 'G' : 'g';
+    }
+    *spec = '\0';
+
+    char text[sc_maxNumberSize];
+    int length = hex ? std::snprintf(text, sizeof(text), format, number)
+                     : std::snprintf(text, sizeof(text), format, m_precision,
+                                     number);
+
+    if (length < 0) {
+        return;
+    }
+    else if (static_cast<size_t>(length) < sizeof(text)) {
+        put(std::string_view{text, static_cast<size_t>(length)});
+        return;
+    }
+
+    // fixed notation of a big number, or a high precision
+    std::string longText(length + 1, '\0');
+
+    if (hex) {
+        std::snprintf(&longText[0], longText.size(), format, number);
+    }
+    else {
+        std::snprintf(&longText[0], longText.size(), format, m_precision,
+                      number);
+    }
+    put(std::string_view{longText.data(), static_cast<size_t>(length)});
+}
+
+void CSVWriter::putString(std::string_view text) {
+    if (m_format != CSVFormat::CSV ||
+        text.find_first_of(",\"\r\n") == std::string_view::npos)
+    {
+        put(text);
+        return;
+    }
+
+    // quoted, with each quote doubled
+    put('"');
+    size_t start = 0;
+    size_t quote;
+
+    while ((quote = text.find('"', start)) != std::string_view::npos) {
+        put(text.substr(start, quote + 1 - start));
+        put('"');
+        start = quote + 1;
+    }
+    put(text.substr(start));
+    put('"');
+}
+
+void CSVWriter::putDelimiter() {
+    if (m_format == CSVFormat::Debug) {
+        put(", ");
+    }
+    else {
+        put(delimiter());
+    }
+}
+
+void CSVWriter::endRow(int fields, bool lastEmpty) {
+    if (m_format == CSVFormat::Debug) {
+        return;
+    }
+
+    // A line ending in an empty field would lose it when read back: TSV
+    // drops a trailing tab as std::getline() does, and an empty line is
+    // no row at all.
+    if (lastEmpty && m_format == CSVFormat::TSV) {
+        put(delimiter());
+    }
+    else if (lastEmpty && fields == 1) {
+        put("\"\"");
+    }
+    put('\n');
+}
+
+static bool isEmptyString(CellView cell) {
+    return std::holds_alternative<std::string_view>(cell) &&
+           std::get<std::string_view>(cell).empty();
+}
+
+void CSVWriter::writeCell(CellView cell) {
+    if (std::holds_alternative<double>(cell)) {
+        putNumber(std::get<double>(cell));
+    }
+    else {
+        putString(std::get<std::string_view>(cell));
+    }
+}
+
+void CSVWriter::writeRow(const CSVRow &row) {
+    int size = row.size();
+
+    if (m_format == CSVFormat::Debug) {
+        put('(');
+    }
+    for (int column = 0; column < size; ++column) {
+        if (column > 0) {
+            putDelimiter();
+        }
+        writeCell(row[column]);
+    }
+    if (m_format == CSVFormat::Debug) {
+        put(')');
+    }
+    endRow(size, size > 0 && isEmptyString(toCellView(row[size - 1])));
+}
+
+void CSVWriter::writeRow(const CSVRowView &row) {
+    int size = row.size();
+
+    if (m_format == CSVFormat::Debug) {
+        put('(');
+    }
+    for (int column = 0; column < size; ++column) {
+        if (column > 0) {
+            putDelimiter();
+        }
+        writeCell(row[column]);
+    }
+    if (m_format == CSVFormat::Debug) {
+        put(')');
+    }
+    endRow(size, size > 0 && isEmptyString(row[size - 1]));
+}
+
+void CSVWriter::writeColumn(const CSVColumnView &column) {
+    int rows = column.size();
+
+    if (m_format == CSVFormat::Debug) {
+        put('(');
+    }
+    for (int row = 0; row < rows; ++row) {
+        if (row > 0) {
+            putDelimiter();
+        }
+        writeCell(column.cellView(row));
+    }
+    if (m_format == CSVFormat::Debug) {
+        put(')');
+    }
+    endRow(rows, rows > 0 && isEmptyString(column.cellView(rows - 1)));
+}
+
+void CSVWriter::writeFile(const CSVFile &csvFile) {
+    int rows = csvFile.size();
+
+    if (m_format == CSVFormat::Debug) {
+        put('(');
+    }
+    for (int row = 0; row < rows; ++row) {
+        if (row > 0 && m_format == CSVFormat::Debug) {
+            put(", ");
+        }
+        writeRow(csvFile.getRowView(row));
+    }
+    if (m_format == CSVFormat::Debug) {
+        put(')');
+    }
+}
@@ -0,0 +1,349 @@
+//============================================================================
+// Name        : CompressedFile.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Reading a gzip or zstd compressed file, decompressed on a
+//               thread of its own.
+//============================================================================
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "CSVFile.h"
+#include "CompressedFile.h"
+
+
+CompressedFile::CompressedFile(const std::string &filePath,
+                               size_t bufferSize, int buffers)
+    : m_ring(std::max(buffers, 2)),
+      m_bufferSize{std::max<size_t>(bufferSize, 1)}
+{
+    m_compression = detect(filePath);
+
+    if (m_compression == Compression::None) {
+        throw FileError{"FileException: File is not compressed!"};
+    }
+    else if (!supports(m_compression)) {
+        throw FileError{"FileException: Built without support for "
+                        "this compression!"};
+    }
+
+    m_fd = ::open(filePath.c_str(), O_RDONLY);
+
+    if (m_fd < 0) {
+        throw FileError{"FileException: Could not open file for reading!"};
+    }
+
+    for (Buffer &buffer : m_ring) {
+        buffer.data.reset(new char[m_bufferSize]);
+    }
+
+    m_worker = std::thread{&CompressedFile::decompress, this};
+}
+
+CompressedFile::~CompressedFile() {
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stop = true;
+    }
+    m_filledChanged.notify_all();
+
+    m_worker.join();
+    ::close(m_fd);
+}
+
+Compression CompressedFile::detect(const std::string &filePath) {
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return Compression::None;
+    }
+
+    unsigned char magic[4] = {};
+    ssize_t size = ::read(fd, magic, sizeof(magic));
+
+    ::close(fd);
+
+    if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return Compression::Gzip;
+    }
+    else if (size == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+             magic[2] == 0x2f && magic[3] == 0xfd) {
+        return Compression::Zstd;
+    }
+
+    return Compression::None;
+}
+
+bool CompressedFile::supports(Compression compression) {
+    switch (compression) {
+    case Compression::None:
+        return true;
+    case Compression::Gzip:
+#ifdef HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case Compression::Zstd:
+#ifdef HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+void CompressedFile::decompress() {
+    try {
+        if (m_compression == Compression::Gzip) {
+            inflateGzip();
+        }
+        else {
+            decompressZstd();
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_done = true;
+    }
+    m_filledChanged.notify_all();
+}
+
+size_t CompressedFile::readInput(char *input, size_t size) {
+    while (true) {
+        ssize_t got = ::read(m_fd, input, size);
+
+        if (got >= 0) {
+            return got;
+        }
+        else if (errno != EINTR) {
+            throw FileError{"FileException: Could not read file!"};
+        }
+    }
+}
+
+CompressedFile::Buffer* CompressedFile::emptyBuffer() {
+    std::unique_lock<std::mutex> lock{m_mutex};
+
+    m_filledChanged.wait(lock, [this]() {
+        return m_stop || m_filled < m_ring.size();
+    });
+
+    if (m_stop) {
+        return nullptr;
+    }
+
+    return &m_ring[(m_head + m_filled) % m_ring.size()];
+}
+
+void CompressedFile::filledBuffer(Buffer *buffer, size_t size) {
+    buffer->size = size;
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        ++m_filled;
+    }
+    m_filledChanged.notify_all();
+}
+
+void CompressedFile::inflateGzip() {
+#ifdef HAVE_ZLIB
+    z_stream stream{};
+
+    // 15 + 32: the largest window, with a gzip or zlib header
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        throw FileError{"FileException: Could not decompress file!"};
+    }
+
+    std::unique_ptr<z_stream, int (*)(z_streamp)> cleanup{&stream,
+                                                          inflateEnd};
+    std::unique_ptr<char[]> input{new char[sc_inputSize]};
+    bool eof = false;
+    bool ended = false;   // at the end of a gzip member
+
+    Buffer *buffer = emptyBuffer();
+
+    if (buffer == nullptr) {
+        return;
+    }
+    stream.next_out = reinterpret_cast<Bytef*>(buffer->data.get());
+    stream.avail_out = m_bufferSize;
+
+    while (true) {
+        if (stream.avail_in == 0 && !eof) {
+            size_t got = readInput(input.get(), sc_inputSize);
+
+            eof = (got == 0);
+            stream.next_in = reinterpret_cast<Bytef*>(input.get());
+            stream.avail_in = got;
+        }
+
+        int status = inflate(&stream, Z_NO_FLUSH);
+
+        if (status == Z_STREAM_END) {
+            // another member may follow
+            ended = true;
+            inflateReset(&stream);
+        }
+        else if (status == Z_OK) {
+            ended = false;
+        }
+        else if (status == Z_BUF_ERROR && stream.avail_in == 0 && eof) {
+            if (!ended) {
+                throw FileError{"FileException: Compressed file is "
+                                "truncated!"};
+            }
+            break;
+        }
+        else if (status == Z_DATA_ERROR && ended) {
+            // gzip ignores anything after the last member, so we do too
+            break;
+        }
+        else if (status != Z_BUF_ERROR) {
+            throw FileError{"FileException: Could not decompress file!"};
+        }
+
+        if (stream.avail_out == 0) {
+            filledBuffer(buffer, m_bufferSize);
+
+            if ((buffer = emptyBuffer()) == nullptr) {
+                return;
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(buffer->data.get());
+            stream.avail_out = m_bufferSize;
+        }
+    }
+
+    if (stream.avail_out < m_bufferSize) {
+        filledBuffer(buffer, m_bufferSize - stream.avail_out);
+    }
+#endif
+}
+
+void CompressedFile::decompressZstd() {
+#ifdef HAVE_ZSTD
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context{
+        ZSTD_createDCtx(), ZSTD_freeDCtx};
+
+    if (!context) {
+        throw FileError{"FileException: Could not decompress file!"};
+    }
+
+    std::unique_ptr<char[]> input{new char[sc_inputSize]};
+    ZSTD_inBuffer in{input.get(), 0, 0};
+    bool eof = false;
+    bool outputFull = false;
+    size_t hint = 0;   // 0 once a frame is complete
+
+    Buffer *buffer = emptyBuffer();
+
+    if (buffer == nullptr) {
+        return;
+    }
+    ZSTD_outBuffer out{buffer->data.get(), m_bufferSize, 0};
+
+    while (true) {
+        if (in.pos == in.size && !eof) {
+            in.size = readInput(input.get(), sc_inputSize);
+            in.pos = 0;
+            eof = (in.size == 0);
+        }
+
+        // a full buffer may have left more output to flush
+        if (in.pos == in.size && eof && !outputFull) {
+            if (hint != 0) {
+                throw FileError{"FileException: Compressed file is "
+                                "truncated!"};
+            }
+            break;
+        }
+
+        hint = ZSTD_decompressStream(context.get(), &out, &in);
+
+        if (ZSTD_isError(hint)) {
+            throw FileError{"FileException: Could not decompress file!"};
+        }
+
+        outputFull = (out.pos == out.size);
+
+        if (outputFull) {
+            filledBuffer(buffer, m_bufferSize);
+
+            if ((buffer = emptyBuffer()) == nullptr) {
+                return;
+            }
+            out = ZSTD_outBuffer{buffer->data.get(), m_bufferSize, 0};
+        }
+    }
+
+    if (out.pos > 0) {
+        filledBuffer(buffer, out.pos);
+    }
+#endif
+}
+
+bool CompressedFile::next(std::string_view &chunk) {
+    std::unique_lock<std::mutex> lock{m_mutex};
+
+    if (m_holding) {
+        m_head = (m_head + 1) % m_ring.size();
+        --m_filled;
+        m_holding = false;
+        m_filledChanged.notify_all();
+    }
+
+    m_filledChanged.wait(lock, [this]() {
+        return m_filled > 0 || m_done;
+    });
+
+    if (m_filled > 0) {
+        m_holding = true;
+        chunk = std::string_view{m_ring[m_head].data.get(),
+                                 m_ring[m_head].size};
+        return true;
+    }
+    else if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+
+    chunk = std::string_view{};
+    return false;
+}
+
+size_t CompressedFile::read(char *out, size_t size) {
+    size_t copied = 0;
+
+    while (copied < size) {
+        if (m_rest.empty() && !next(m_rest)) {
+            break;
+        }
+
+        size_t count = std::min(size - copied, m_rest.size());
+
+        std::memcpy(out + copied, m_rest.data(), count);
+        m_rest.remove_prefix(count);
+        copied += count;
+    }
+
+    return copied;
+}
@@ -0,0 +1,57 @@
+//============================================================================
+// Name        : MappedFile.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Read-only memory mapping of a whole file.
+//============================================================================
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CSVFile.h"
+#include "MappedFile.h"
+
+
+MappedFile::MappedFile(const std::string &filePath) {
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        throw FileError{"FileException: Could not open file for reading!"};
+    }
+
+    struct stat status{};
+    if (::fstat(fd, &status) < 0) {
+        ::close(fd);
+        throw FileError{"FileException: Could not stat file!"};
+    }
+
+    m_size = static_cast<size_t>(status.st_size);
+
+    // mmap() refuses zero length mappings, so an empty file simply has
+    // no data.
+    if (m_size > 0) {
+        void *addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            throw FileError{"FileException: Could not map file into memory!"};
+        }
+
+        ::madvise(addr, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(addr);
+    }
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+}
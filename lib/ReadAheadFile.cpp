@@ -0,0 +1,530 @@
+//============================================================================
+// Name        : ReadAheadFile.cpp
+// Author      : James L. Makela
+// Version     : 0.0.1
+// Copyright   : LGPL v3.0
+// Description : Reading a file in large blocks, ahead of whoever is using
+//               them.
+//============================================================================
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// the system call numbers, as we use io_uring without liburing
+#if defined(HAVE_IO_URING) && !defined(__NR_io_uring_setup)
+#undef HAVE_IO_URING
+#endif
+
+#include "CSVFile.h"
+#include "ReadAheadFile.h"
+
+
+#ifdef HAVE_IO_URING
+// The three regions io_uring shares with us: the submission queue, the
+// completion queue, and the submission entries themselves.
+struct ReadAheadFile::Ring
+{
+    int fd{-1};
+
+    void *sq{MAP_FAILED};
+    size_t sqSize{0};
+    void *cq{MAP_FAILED};
+    size_t cqSize{0};
+    void *sqes{MAP_FAILED};
+    size_t sqesSize{0};
+
+    unsigned *sqTail{nullptr};
+    unsigned *sqMask{nullptr};
+    unsigned *sqArray{nullptr};
+    io_uring_sqe *sqEntries{nullptr};
+
+    unsigned *cqHead{nullptr};
+    unsigned *cqTail{nullptr};
+    unsigned *cqMask{nullptr};
+    io_uring_cqe *cqEntries{nullptr};
+
+    // one per block, which READV reads into
+    std::vector<iovec> iovecs{};
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqesSize);
+        }
+        if (cq != MAP_FAILED && cq != sq) {
+            ::munmap(cq, cqSize);
+        }
+        if (sq != MAP_FAILED) {
+            ::munmap(sq, sqSize);
+        }
+        ::close(fd);
+    }
+
+    int enter(unsigned submit, unsigned wait) {
+        return ::syscall(__NR_io_uring_enter, fd, submit, wait,
+                         wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    }
+};
+#else
+struct ReadAheadFile::Ring
+{
+};
+#endif
+
+
+void ReadAheadFile::AlignedDelete::operator()(char *data) const {
+    ::operator delete[](data, std::align_val_t{sc_alignment});
+}
+
+ReadAheadFile::ReadAheadFile(const std::string &filePath, bool direct,
+                             size_t blockSize, int blocks)
+    : m_blocks(std::max(blocks, 2))
+{
+    // whole pages, which O_DIRECT needs
+    m_blockSize = std::max(sc_alignment, (blockSize + sc_alignment - 1) /
+                                         sc_alignment * sc_alignment);
+
+#ifdef O_DIRECT
+    if (direct) {
+        // some file systems do not allow it, so we simply go without
+        m_fd = ::open(filePath.c_str(), O_RDONLY | O_DIRECT);
+        m_direct = (m_fd >= 0);
+    }
+#endif
+    if (m_fd < 0) {
+        m_fd = ::open(filePath.c_str(), O_RDONLY);
+    }
+
+    if (m_fd < 0) {
+        throw FileError{"FileException: Could not open file for reading!"};
+    }
+
+    struct stat status;
+
+    if (::fstat(m_fd, &status) == 0 && S_ISREG(status.st_mode)) {
+        m_regular = true;
+        m_fileSize = status.st_size;
+    }
+
+    for (Block &block : m_blocks) {
+        block.data.reset(static_cast<char*>(
+            ::operator new[](m_blockSize, std::align_val_t{sc_alignment})));
+    }
+
+    // io_uring reads at offsets, so it only does regular files
+    if (m_regular && startRing()) {
+        m_backend = ReadAheadBackend::IoUring;
+
+        try {
+            for (Block &block : m_blocks) {
+                if (m_nextOffset < m_fileSize) {
+                    queueBlock(block);
+                }
+                else {
+                    block.offset = m_fileSize;
+                }
+            }
+        }
+        catch (const Exception &) {
+            for (Block &block : m_blocks) {
+                waitForBlock(block);
+            }
+            m_ring.reset();
+            ::close(m_fd);
+            throw;
+        }
+        return;
+    }
+
+    m_worker = std::thread{&ReadAheadFile::readAhead, this};
+}
+
+ReadAheadFile::~ReadAheadFile() {
+    if (m_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_stop = true;
+        }
+        m_filledChanged.notify_all();
+        m_worker.join();
+    }
+
+    // the kernel must be done writing into the blocks before they go
+    if (m_ring) {
+        try {
+            for (Block &block : m_blocks) {
+                waitForBlock(block);
+            }
+        }
+        catch (const Exception &) {
+            // nowhere to report it from here
+        }
+        m_ring.reset();
+    }
+
+    ::close(m_fd);
+}
+
+bool ReadAheadFile::next(std::string_view &chunk) {
+    return m_ring ? nextQueued(chunk) : nextRead(chunk);
+}
+
+size_t ReadAheadFile::read(char *out, size_t size) {
+    size_t copied = 0;
+
+    while (copied < size) {
+        if (m_rest.empty() && !next(m_rest)) {
+            break;
+        }
+
+        size_t count = std::min(size - copied, m_rest.size());
+
+        std::memcpy(out + copied, m_rest.data(), count);
+        m_rest.remove_prefix(count);
+        copied += count;
+    }
+
+    return copied;
+}
+
+//
+// With a thread reading ahead
+//
+size_t ReadAheadFile::readAt(char *data, size_t done, size_t wanted,
+                             uint64_t offset)
+{
+    while (done < wanted) {
+        size_t start = done;
+        size_t length = wanted - done;
+
+        // O_DIRECT wants the offset and length aligned, which a short
+        // read leaves them not, so go back to where they were and read
+        // what we had again
+        if (m_direct) {
+            start = done / sc_alignment * sc_alignment;
+            length = (wanted - start + sc_alignment - 1) / sc_alignment *
+                     sc_alignment;
+        }
+
+        ssize_t got = ::pread(m_fd, data + start, length, offset + start);
+
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw FileError{"FileException: Could not read file!"};
+        }
+        else if (start + got <= done) {
+            break;  // the end of the file, which may have shrunk
+        }
+        done = std::min(start + got, wanted);
+    }
+
+    return done;
+}
+
+size_t ReadAheadFile::readBlock(char *data) {
+    // a regular file is read at offsets, which O_DIRECT needs aligned
+    if (m_regular) {
+        size_t size = readAt(data, 0, m_blockSize, m_nextOffset);
+
+        m_nextOffset += size;
+        return size;
+    }
+
+    size_t size = 0;
+
+    // a pipe can give us less than we asked for before its end
+    while (size < m_blockSize) {
+        ssize_t got = ::read(m_fd, data + size, m_blockSize - size);
+
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw FileError{"FileException: Could not read file!"};
+        }
+        else if (got == 0) {
+            break;
+        }
+        size += got;
+    }
+
+    return size;
+}
+
+void ReadAheadFile::readAhead() {
+    try {
+        while (true) {
+            Block *block;
+
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+
+                m_filledChanged.wait(lock, [this]() {
+                    return m_stop || m_filled < m_blocks.size();
+                });
+
+                if (m_stop) {
+                    break;
+                }
+                block = &m_blocks[(m_head + m_filled) % m_blocks.size()];
+            }
+
+            block->size = readBlock(block->data.get());
+
+            if (block->size == 0) {
+                break;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                ++m_filled;
+            }
+            m_filledChanged.notify_all();
+
+            if (block->size < m_blockSize) {
+                break;
+            }
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_done = true;
+    }
+    m_filledChanged.notify_all();
+}
+
+bool ReadAheadFile::nextRead(std::string_view &chunk) {
+    std::unique_lock<std::mutex> lock{m_mutex};
+
+    if (m_holding) {
+        m_head = (m_head + 1) % m_blocks.size();
+        --m_filled;
+        m_holding = false;
+        m_filledChanged.notify_all();
+    }
+
+    m_filledChanged.wait(lock, [this]() {
+        return m_filled > 0 || m_done;
+    });
+
+    if (m_filled > 0) {
+        m_holding = true;
+        chunk = std::string_view{m_blocks[m_head].data.get(),
+                                 m_blocks[m_head].size};
+        return true;
+    }
+    else if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+
+    chunk = std::string_view{};
+    return false;
+}
+
+//
+// With io_uring.  The blocks are queued in file order, so they come back
+// to the reader in ring order whatever order the kernel finishes them in.
+//
+bool ReadAheadFile::startRing() {
+#ifdef HAVE_IO_URING
+    io_uring_params params{};
+    int fd = ::syscall(__NR_io_uring_setup, m_blocks.size(), &params);
+
+    if (fd < 0) {
+        // an old kernel, or one that does not let us
+        return false;
+    }
+
+    auto ring = std::make_unique<Ring>();
+    ring->fd = fd;
+
+    ring->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqSize = params.cq_off.cqes +
+                   params.cq_entries * sizeof(io_uring_cqe);
+
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+
+    if (single) {
+        ring->sqSize = ring->cqSize = std::max(ring->sqSize, ring->cqSize);
+    }
+
+    ring->sq = ::mmap(nullptr, ring->sqSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq == MAP_FAILED) {
+        return false;
+    }
+
+    ring->cq = single ? ring->sq
+                      : ::mmap(nullptr, ring->cqSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_CQ_RING);
+    if (ring->cq == MAP_FAILED) {
+        return false;
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = ::mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        return false;
+    }
+
+    char *sq = static_cast<char*>(ring->sq);
+    char *cq = static_cast<char*>(ring->cq);
+
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->sqEntries = static_cast<io_uring_sqe*>(ring->sqes);
+
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqEntries = reinterpret_cast<io_uring_cqe*>(cq +
+                                                      params.cq_off.cqes);
+
+    ring->iovecs.resize(m_blocks.size());
+    m_ring = std::move(ring);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ReadAheadFile::queueBlock(Block &block) {
+#ifdef HAVE_IO_URING
+    Ring &ring = *m_ring;
+    size_t index = &block - m_blocks.data();
+
+    block.offset = m_nextOffset;
+    m_nextOffset += m_blockSize;
+
+    ring.iovecs[index] = iovec{block.data.get(), m_blockSize};
+
+    // we are the only ones adding entries, so the tail is ours to read
+    unsigned tail = *ring.sqTail;
+    unsigned slot = tail & *ring.sqMask;
+    io_uring_sqe &entry = ring.sqEntries[slot];
+
+    std::memset(&entry, 0, sizeof(entry));
+    entry.opcode = IORING_OP_READV;
+    entry.fd = m_fd;
+    entry.addr = reinterpret_cast<uint64_t>(&ring.iovecs[index]);
+    entry.len = 1;
+    entry.off = block.offset;
+    entry.user_data = index;
+
+    ring.sqArray[slot] = slot;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+
+    while ((submitted = ring.enter(1, 0)) < 0 && errno == EINTR) {
+    }
+
+    if (submitted != 1) {
+        throw FileError{"FileException: Could not read file!"};
+    }
+    block.pending = true;
+#endif
+}
+
+void ReadAheadFile::waitForBlock(Block &block) {
+#ifdef HAVE_IO_URING
+    Ring &ring = *m_ring;
+
+    // take whatever has finished until this block has
+    while (block.pending) {
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (ring.enter(0, 1) < 0 && errno != EINTR) {
+                throw FileError{"FileException: Could not read file!"};
+            }
+            continue;
+        }
+
+        const io_uring_cqe &completion = ring.cqEntries[head & *ring.cqMask];
+        Block &done = m_blocks[completion.user_data];
+
+        done.result = completion.res;
+        done.pending = false;
+        __atomic_store_n(ring.cqHead, head + 1, __ATOMIC_RELEASE);
+    }
+#endif
+}
+
+void ReadAheadFile::finishBlock(Block &block) {
+    size_t wanted = 0;
+
+    if (block.offset < m_fileSize) {
+        wanted = std::min<uint64_t>(m_blockSize, m_fileSize - block.offset);
+    }
+
+    if (block.result < 0 && block.result != -EINTR &&
+        block.result != -EAGAIN)
+    {
+        throw FileError{"FileException: Could not read file!"};
+    }
+
+    // Finish a short or interrupted read ourselves.  A file that shrank
+    // since we opened it just ends early.
+    block.size = std::min<size_t>(std::max(block.result, 0), wanted);
+    block.size = readAt(block.data.get(), block.size, wanted, block.offset);
+}
+
+bool ReadAheadFile::nextQueued(std::string_view &chunk) {
+    if (m_holding) {
+        Block &held = m_blocks[m_head];
+
+        m_holding = false;
+        m_head = (m_head + 1) % m_blocks.size();
+
+        // it goes to the back of the queue, for the next block of the file
+        if (m_nextOffset < m_fileSize) {
+            queueBlock(held);
+        }
+        else {
+            held.offset = m_fileSize;
+        }
+    }
+
+    Block &block = m_blocks[m_head];
+
+    // a block not read since it was last handed out means the end
+    if (block.offset >= m_fileSize) {
+        return false;
+    }
+
+    waitForBlock(block);
+    finishBlock(block);
+
+    if (block.size == 0) {
+        return false;
+    }
+
+    m_holding = true;
+    chunk = std::string_view{block.data.get(), block.size};
+    return true;
+}
@@ -11,19 +11,34 @@
 //                  extra mix from long hash
 
 #include <memory.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
 #include "SpookyV2.h"
 
+// configure --disable-unaligned-reads builds with this 0
+#ifndef ALLOW_UNALIGNED_READS
 #define ALLOW_UNALIGNED_READS 1
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPOOKY_X86 1
+#endif
 
 //
 // short hash ... it could be used on any message,
 // but it's used by Spooky just for short messages.
 //
-void SpookyHash::Short(
+INLINE void SpookyHash::ShortStart(
     const void *message,
     size_t length,
-    uint64 *hash1,
-    uint64 *hash2)
+    uint64 &a, uint64 &b, uint64 &c, uint64 &d)
 {
     uint64 buf[2*sc_numVars];
     union
@@ -43,10 +58,8 @@ void SpookyHash::Short(
     }
 
     size_t remainder = length%32;
-    uint64 a=*hash1;
-    uint64 b=*hash2;
-    uint64 c=sc_const;
-    uint64 d=sc_const;
+    c=sc_const;
+    d=sc_const;
 
     if (length > 15)
     {
@@ -116,6 +129,19 @@ void SpookyHash::Short(
         c += sc_const;
         d += sc_const;
     }
+}
+
+void SpookyHash::Short(
+    const void *message,
+    size_t length,
+    uint64 *hash1,
+    uint64 *hash2)
+{
+    uint64 a=*hash1;
+    uint64 b=*hash2;
+    uint64 c, d;
+
+    ShortStart(message, length, a, b, c, d);
     ShortEnd(a,b,c,d);
     *hash1 = a;
     *hash2 = b;
@@ -124,6 +150,270 @@ void SpookyHash::Short(
 
 
 
+//
+// ShortEnd on eight states at once.  The states are independent,
+// so the processor can overlap their chains of dependent instructions.
+//
+static void ShortEndLanes(uint64 *h0, uint64 *h1, uint64 *h2, uint64 *h3)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        SpookyHash::ShortEnd(h0[i], h1[i], h2[i], h3[i]);
+    }
+}
+
+#ifdef SPOOKY_X86
+
+// AVX2 has no 64 bit rotate, so it takes two shifts and an or
+#define SPOOKY_ROT4(x, k) \
+    _mm256_or_si256(_mm256_slli_epi64((x), (k)), _mm256_srli_epi64((x), 64-(k)))
+
+#define SPOOKY_END4(h0, h1, h2, h3) \
+    h3 = _mm256_xor_si256(h3, h2);  h2 = SPOOKY_ROT4(h2,15);  h3 = _mm256_add_epi64(h3, h2); \
+    h0 = _mm256_xor_si256(h0, h3);  h3 = SPOOKY_ROT4(h3,52);  h0 = _mm256_add_epi64(h0, h3); \
+    h1 = _mm256_xor_si256(h1, h0);  h0 = SPOOKY_ROT4(h0,26);  h1 = _mm256_add_epi64(h1, h0); \
+    h2 = _mm256_xor_si256(h2, h1);  h1 = SPOOKY_ROT4(h1,51);  h2 = _mm256_add_epi64(h2, h1); \
+    h3 = _mm256_xor_si256(h3, h2);  h2 = SPOOKY_ROT4(h2,28);  h3 = _mm256_add_epi64(h3, h2); \
+    h0 = _mm256_xor_si256(h0, h3);  h3 = SPOOKY_ROT4(h3,9);   h0 = _mm256_add_epi64(h0, h3); \
+    h1 = _mm256_xor_si256(h1, h0);  h0 = SPOOKY_ROT4(h0,47);  h1 = _mm256_add_epi64(h1, h0); \
+    h2 = _mm256_xor_si256(h2, h1);  h1 = SPOOKY_ROT4(h1,54);  h2 = _mm256_add_epi64(h2, h1); \
+    h3 = _mm256_xor_si256(h3, h2);  h2 = SPOOKY_ROT4(h2,32);  h3 = _mm256_add_epi64(h3, h2); \
+    h0 = _mm256_xor_si256(h0, h3);  h3 = SPOOKY_ROT4(h3,25);  h0 = _mm256_add_epi64(h0, h3); \
+    h1 = _mm256_xor_si256(h1, h0);  h0 = SPOOKY_ROT4(h0,63);  h1 = _mm256_add_epi64(h1, h0);
+
+//
+// The same, with four states to a register and two registers of states
+// going at once.
+//
+__attribute__((target("avx2")))
+static void ShortEndLanesAVX2(uint64 *h0, uint64 *h1, uint64 *h2, uint64 *h3)
+{
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)h0);
+    __m256i b0 = _mm256_loadu_si256((const __m256i *)h1);
+    __m256i c0 = _mm256_loadu_si256((const __m256i *)h2);
+    __m256i d0 = _mm256_loadu_si256((const __m256i *)h3);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(h0 + 4));
+    __m256i b1 = _mm256_loadu_si256((const __m256i *)(h1 + 4));
+    __m256i c1 = _mm256_loadu_si256((const __m256i *)(h2 + 4));
+    __m256i d1 = _mm256_loadu_si256((const __m256i *)(h3 + 4));
+
+    SPOOKY_END4(a0, b0, c0, d0)
+    SPOOKY_END4(a1, b1, c1, d1)
+
+    _mm256_storeu_si256((__m256i *)h0, a0);
+    _mm256_storeu_si256((__m256i *)(h0 + 4), a1);
+}
+
+#undef SPOOKY_END4
+#undef SPOOKY_ROT4
+
+#endif // SPOOKY_X86
+
+
+void SpookyHash::Hash64Batch(
+    const void *const *messages,
+    const size_t *lengths,
+    size_t count,
+    uint64 seed,
+    uint64 *hashes)
+{
+#if defined(SPOOKY_X86) && !defined(SPOOKY_NO_DISPATCH)
+    static const bool useAVX2 = __builtin_cpu_supports("avx2");
+#else
+    static const bool useAVX2 = false;
+#endif
+
+    uint64 a[sc_batchLanes], b[sc_batchLanes];
+    uint64 c[sc_batchLanes], d[sc_batchLanes];
+
+    for (size_t start = 0; start < count; start += sc_batchLanes)
+    {
+        size_t lanes = count - start;
+        if (lanes > sc_batchLanes)
+            lanes = sc_batchLanes;
+
+        for (size_t i = 0; i < sc_batchLanes; ++i)
+        {
+            a[i] = b[i] = seed;
+            c[i] = d[i] = 0;
+
+            if (i >= lanes)
+                continue;
+
+            size_t length = lengths[start+i];
+            const uint8 *p8 = (const uint8 *)messages[start+i];
+
+            // Under 16 bytes there is no ShortMix, only the last 0..15
+            // bytes.  Rather than Short's switch, gather them as two words
+            // padded with zeros, from loads that overlap instead of
+            // reading past the end of the message.
+            if (length < 16)
+            {
+                uint64 lo = 0, hi = 0;
+
+                if (length >= 8)
+                {
+                    memcpy(&lo, p8, 8);
+                    if (length > 8)
+                    {
+                        memcpy(&hi, p8 + length - 8, 8);
+                        hi >>= (16 - length) * 8;
+                    }
+                }
+                else if (length >= 4)
+                {
+                    uint32 first, last;
+                    memcpy(&first, p8, 4);
+                    memcpy(&last, p8 + length - 4, 4);
+                    lo = first | ((uint64)last << ((length - 4) * 8));
+                }
+                else if (length > 0)
+                {
+                    lo = p8[0] | ((uint64)p8[length/2] << (length/2*8))
+                         | ((uint64)p8[length-1] << ((length-1)*8));
+                }
+
+                c[i] = sc_const + lo;
+                d[i] = sc_const + hi + (((uint64)length) << 56);
+                if (length == 0)
+                {
+                    c[i] += sc_const;
+                    d[i] += sc_const;
+                }
+            }
+            // long messages take the usual path, and their lanes idle
+            else if (length < sc_bufSize)
+            {
+                ShortStart(p8, length, a[i], b[i], c[i], d[i]);
+            }
+        }
+
+#ifdef SPOOKY_X86
+        if (useAVX2)
+            ShortEndLanesAVX2(a, b, c, d);
+        else
+#endif
+            ShortEndLanes(a, b, c, d);
+
+        for (size_t i = 0; i < lanes; ++i)
+        {
+            if (lengths[start+i] < sc_bufSize)
+                hashes[start+i] = a[i];
+            else
+                hashes[start+i] = Hash64(messages[start+i], lengths[start+i],
+                                         seed);
+        }
+    }
+}
+
+
+
+// Mix whole blocks into the state, reading them in place
+INLINE void SpookyHash::MixBlocksAt(
+    const uint8 *blocks,
+    size_t count,
+    uint64 *state)
+{
+    uint64 h0 = state[0], h1 = state[1], h2 = state[2], h3 = state[3];
+    uint64 h4 = state[4], h5 = state[5], h6 = state[6], h7 = state[7];
+    uint64 h8 = state[8], h9 = state[9], h10 = state[10], h11 = state[11];
+    const uint8 *end = blocks + count*sc_blockSize;
+
+    for (; blocks < end; blocks += sc_blockSize)
+    {
+        Mix((const uint64 *)blocks, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
+    }
+
+    state[0] = h0;  state[1] = h1;  state[2] = h2;   state[3] = h3;
+    state[4] = h4;  state[5] = h5;  state[6] = h6;   state[7] = h7;
+    state[8] = h8;  state[9] = h9;  state[10] = h10; state[11] = h11;
+}
+
+// Mix whole blocks into the state, copying each one out first if it is
+// not aligned and unaligned reads are not allowed
+void SpookyHash::MixBlocks(
+    const uint8 *blocks,
+    size_t count,
+    uint64 *state)
+{
+    if (ALLOW_UNALIGNED_READS || (((size_t)blocks & 0x7) == 0))
+    {
+        MixBlocksAt(blocks, count, state);
+        return;
+    }
+
+    uint64 buf[sc_numVars];
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        memcpy(buf, blocks + i*sc_blockSize, sc_blockSize);
+        MixBlocksAt((const uint8 *)buf, 1, state);
+    }
+}
+
+#ifdef SPOOKY_X86
+
+// the same, built so every Rot64 is one rorx instead of a mov and a rol
+__attribute__((target("bmi2")))
+void SpookyHash::MixBlocksBMI2(
+    const uint8 *blocks,
+    size_t count,
+    uint64 *state)
+{
+    if (!ALLOW_UNALIGNED_READS && (((size_t)blocks & 0x7) != 0))
+    {
+        MixBlocks(blocks, count, state);
+        return;
+    }
+
+    MixBlocksAt(blocks, count, state);
+}
+
+#endif // SPOOKY_X86
+
+
+SpookyHash::Impl SpookyHash::Best()
+{
+#if defined(SPOOKY_X86) && !defined(SPOOKY_NO_DISPATCH)
+    static const Impl impl = __builtin_cpu_supports("bmi2") ? BMI2
+                                                            : Portable;
+    return impl;
+#else
+    return Portable;
+#endif
+}
+
+const char *SpookyHash::Name(Impl impl)
+{
+    switch (impl)
+    {
+    case BMI2:
+        return "bmi2";
+    default:
+        return "portable";
+    }
+}
+
+bool SpookyHash::Supported(Impl impl)
+{
+#if defined(SPOOKY_X86)
+    return impl == Portable ||
+           (impl == BMI2 && __builtin_cpu_supports("bmi2"));
+#else
+    return impl == Portable;
+#endif
+}
+
+SpookyHash::MixBlocksFn SpookyHash::MixBlocksFor(Impl impl)
+{
+#ifdef SPOOKY_X86
+    if (impl == BMI2)
+        return MixBlocksBMI2;
+#endif
+    return MixBlocks;
+}
+
+
 // do the whole hash in one call
 void SpookyHash::Hash128(
     const void *message,
@@ -137,53 +427,58 @@ void SpookyHash::Hash128(
         return;
     }
 
-    uint64 h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11;
-    uint64 buf[sc_numVars];
-    uint64 *end;
-    union
+    static const MixBlocksFn mixBlocks = MixBlocksFor(Best());
+    Hash128With(mixBlocks, message, length, hash1, hash2);
+}
+
+// the same, mixing blocks the way impl does
+void SpookyHash::Hash128(
+    Impl impl,
+    const void *message,
+    size_t length,
+    uint64 *hash1,
+    uint64 *hash2)
+{
+    Hash128With(MixBlocksFor(impl), message, length, hash1, hash2);
+}
+
+// do the whole hash in one call, mixing blocks with mixBlocks
+void SpookyHash::Hash128With(
+    MixBlocksFn mixBlocks,
+    const void *message,
+    size_t length,
+    uint64 *hash1,
+    uint64 *hash2)
+{
+    if (length < sc_bufSize)
     {
-        const uint8 *p8;
-        uint64 *p64;
-        size_t i;
-    } u;
-    size_t remainder;
+        Short(message, length, hash1, hash2);
+        return;
+    }
 
-    h0=h3=h6=h9  = *hash1;
-    h1=h4=h7=h10 = *hash2;
-    h2=h5=h8=h11 = sc_const;
+    uint64 h[sc_numVars];
+    uint64 buf[sc_numVars];
+    size_t blocks = length/sc_blockSize;
+    const uint8 *end = (const uint8 *)message + blocks*sc_blockSize;
+    size_t remainder;
 
-    u.p8 = (const uint8 *)message;
-    end = u.p64 + (length/sc_blockSize)*sc_numVars;
+    h[0]=h[3]=h[6]=h[9]  = *hash1;
+    h[1]=h[4]=h[7]=h[10] = *hash2;
+    h[2]=h[5]=h[8]=h[11] = sc_const;
 
     // handle all whole sc_blockSize blocks of bytes
-    if (ALLOW_UNALIGNED_READS || ((u.i & 0x7) == 0))
-    {
-        while (u.p64 < end)
-        {
-            Mix(u.p64, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
-	    u.p64 += sc_numVars;
-        }
-    }
-    else
-    {
-        while (u.p64 < end)
-        {
-            memcpy(buf, u.p64, sc_blockSize);
-            Mix(buf, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
-	    u.p64 += sc_numVars;
-        }
-    }
+    mixBlocks((const uint8 *)message, blocks, h);
 
     // handle the last partial block of sc_blockSize bytes
-    remainder = (length - ((const uint8 *)end-(const uint8 *)message));
+    remainder = length - blocks*sc_blockSize;
     memcpy(buf, end, remainder);
     memset(((uint8 *)buf)+remainder, 0, sc_blockSize-remainder);
     ((uint8 *)buf)[sc_blockSize-1] = remainder;
 
     // do some final mixing
-    End(buf, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
-    *hash1 = h0;
-    *hash2 = h1;
+    End(buf, h[0],h[1],h[2],h[3],h[4],h[5],h[6],h[7],h[8],h[9],h[10],h[11]);
+    *hash1 = h[0];
+    *hash2 = h[1];
 }
 
 
@@ -201,16 +496,11 @@ void SpookyHash::Init(uint64 seed1, uint64 seed2)
 // add a message fragment to the state
 void SpookyHash::Update(const void *message, size_t length)
 {
-    uint64 h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11;
+    static const MixBlocksFn mixBlocks = MixBlocksFor(Best());
     size_t newLength = length + m_remainder;
+    const uint8 *p8;
+    size_t blocks;
     uint8  remainder;
-    union
-    {
-        const uint8 *p8;
-        uint64 *p64;
-        size_t i;
-    } u;
-    const uint64 *end;
 
     // Is this message fragment too short?  If it is, stuff it away.
     if (newLength < sc_bufSize)
@@ -224,24 +514,9 @@ void SpookyHash::Update(const void *message, size_t length)
     // init the variables
     if (m_length < sc_bufSize)
     {
-        h0=h3=h6=h9  = m_state[0];
-        h1=h4=h7=h10 = m_state[1];
-        h2=h5=h8=h11 = sc_const;
-    }
-    else
-    {
-        h0 = m_state[0];
-        h1 = m_state[1];
-        h2 = m_state[2];
-        h3 = m_state[3];
-        h4 = m_state[4];
-        h5 = m_state[5];
-        h6 = m_state[6];
-        h7 = m_state[7];
-        h8 = m_state[8];
-        h9 = m_state[9];
-        h10 = m_state[10];
-        h11 = m_state[11];
+        m_state[3] = m_state[6] = m_state[9]  = m_state[0];
+        m_state[4] = m_state[7] = m_state[10] = m_state[1];
+        m_state[2] = m_state[5] = m_state[8] = m_state[11] = sc_const;
     }
     m_length = length + m_length;
 
@@ -250,55 +525,23 @@ void SpookyHash::Update(const void *message, size_t length)
     {
         uint8 prefix = sc_bufSize-m_remainder;
         memcpy(&(((uint8 *)m_data)[m_remainder]), message, prefix);
-        u.p64 = m_data;
-        Mix(u.p64, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
-        Mix(&u.p64[sc_numVars], h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
-        u.p8 = ((const uint8 *)message) + prefix;
+        mixBlocks((const uint8 *)m_data, 2, m_state);
+        p8 = ((const uint8 *)message) + prefix;
         length -= prefix;
     }
     else
     {
-        u.p8 = (const uint8 *)message;
+        p8 = (const uint8 *)message;
     }
 
     // handle all whole blocks of sc_blockSize bytes
-    end = u.p64 + (length/sc_blockSize)*sc_numVars;
-    remainder = (uint8)(length-((const uint8 *)end-u.p8));
-    if (ALLOW_UNALIGNED_READS || (u.i & 0x7) == 0)
-    {
-        while (u.p64 < end)
-        {
-            Mix(u.p64, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
-	    u.p64 += sc_numVars;
-        }
-    }
-    else
-    {
-        while (u.p64 < end)
-        {
-            memcpy(m_data, u.p8, sc_blockSize);
-            Mix(m_data, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
-	    u.p64 += sc_numVars;
-        }
-    }
+    blocks = length/sc_blockSize;
+    remainder = (uint8)(length - blocks*sc_blockSize);
+    mixBlocks(p8, blocks, m_state);
 
     // stuff away the last few bytes
     m_remainder = remainder;
-    memcpy(m_data, end, remainder);
-
-    // stuff away the variables
-    m_state[0] = h0;
-    m_state[1] = h1;
-    m_state[2] = h2;
-    m_state[3] = h3;
-    m_state[4] = h4;
-    m_state[5] = h5;
-    m_state[6] = h6;
-    m_state[7] = h7;
-    m_state[8] = h8;
-    m_state[9] = h9;
-    m_state[10] = h10;
-    m_state[11] = h11;
+    memcpy(m_data, p8 + blocks*sc_blockSize, remainder);
 }
 
 
@@ -350,3 +593,223 @@ void SpookyHash::Final(uint64 *hash1, uint64 *hash2)
     *hash2 = h1;
 }
 
+
+
+// hash the chunks from first up to last into digests, two words a chunk
+static void HashChunks(
+    const uint8 *message,
+    size_t length,
+    size_t first,
+    size_t last,
+    uint64 seed1,
+    uint64 seed2,
+    uint64 *digests)
+{
+    for (size_t chunk = first; chunk < last; ++chunk)
+    {
+        size_t start = chunk * SpookyHash::sc_treeChunkSize;
+        size_t size = std::min(length - start, SpookyHash::sc_treeChunkSize);
+        uint64 h1 = seed1;
+        uint64 h2 = seed2;
+
+        SpookyHash::Hash128(message + start, size, &h1, &h2);
+        digests[2*chunk] = h1;
+        digests[2*chunk+1] = h2;
+    }
+}
+
+void SpookyHash::HashTree128(
+    const void *message,
+    size_t length,
+    uint64 *hash1,
+    uint64 *hash2,
+    int threads)
+{
+    const uint8 *p = (const uint8 *)message;
+
+    // an empty message is one empty chunk
+    size_t chunks = std::max<size_t>(1,
+        (length + sc_treeChunkSize - 1) / sc_treeChunkSize);
+    std::vector<uint64> digests(2*chunks);
+
+    if (threads <= 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = (int)std::min<size_t>(threads, chunks);
+
+    if (threads == 1)
+    {
+        HashChunks(p, length, 0, chunks, *hash1, *hash2, &digests[0]);
+    }
+    else
+    {
+        // each thread takes a run of neighbouring chunks
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> errors(threads);
+
+        for (int part = 0; part < threads; ++part)
+        {
+            size_t first = chunks * part / threads;
+            size_t last = chunks * (part + 1) / threads;
+
+            workers.emplace_back([&, part, first, last]()
+            {
+                try
+                {
+                    HashChunks(p, length, first, last, *hash1, *hash2,
+                               &digests[0]);
+                }
+                catch (...)
+                {
+                    errors[part] = std::current_exception();
+                }
+            });
+        }
+
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            workers[i].join();
+        }
+
+        for (size_t i = 0; i < errors.size(); ++i)
+        {
+            if (errors[i])
+            {
+                std::rethrow_exception(errors[i]);
+            }
+        }
+    }
+
+    // The digests are hashed in order, with the version and the length in
+    // the seeds, so a message never hashes like its own list of digests.
+    uint64 h1 = *hash1 ^ ((uint64)sc_treeVersion << 32);
+    uint64 h2 = *hash2 + length;
+
+    Hash128(&digests[0], digests.size() * sizeof(uint64), &h1, &h2);
+    *hash1 = h1;
+    *hash2 = h2;
+}
+
+bool SpookyHash::HashFile128(
+    const char *path,
+    uint64 *hash1,
+    uint64 *hash2,
+    int threads)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t length = (size_t)info.st_size;
+    if (length == 0)
+    {
+        close(fd);
+        HashTree128(0, 0, hash1, hash2, threads);
+        return true;
+    }
+
+    void *data = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // each thread reads its chunks front to back
+    madvise(data, length, MADV_SEQUENTIAL);
+    HashTree128(data, length, hash1, hash2, threads);
+    munmap(data, length);
+
+    return true;
+}
+
+
+//
+// The hashes of messages of bytes i+128, as in Bob Jenkins' own tests, of
+// every length from 0 to sc_verifyLength with seeds 0 and 0, hashed
+// together the same way.  These came from the original SpookyV2 code.
+//
+static const uint64 sc_verifyHash1 = 0x0d00026473db2f03ULL;
+static const uint64 sc_verifyHash2 = 0x9bad72eca183a97cULL;
+
+// whether hashes are the hashes the known answers came from
+static bool VerifyHashes(const uint64 *hashes, size_t count)
+{
+    uint64 hash1 = 0, hash2 = 0;
+
+    SpookyHash::Hash128(hashes, count*sizeof(uint64), &hash1, &hash2);
+    return hash1 == sc_verifyHash1 &&
+           hash2 == sc_verifyHash2;
+}
+
+bool SpookyHash::Verify()
+{
+    const size_t count = sc_verifyLength + 1;
+    const Impl impls[] = {Portable, BMI2};
+    std::vector<uint8> buf(sc_verifyLength + 8);
+    std::vector<uint64> hashes(2*count);
+    std::vector<const void *> messages(count);
+    std::vector<size_t> lengths(count);
+    std::vector<uint64> batch(count);
+    bool ok = true;
+
+    // every alignment, as the blocks are read differently
+    for (size_t offset = 0; offset < 8; ++offset)
+    {
+        uint8 *message = &buf[offset];
+
+        for (size_t i = 0; i < sc_verifyLength; ++i)
+            message[i] = (uint8)(i+128);
+
+        for (size_t i = 0; i < sizeof(impls)/sizeof(impls[0]); ++i)
+        {
+            if (!Supported(impls[i]))
+                continue;
+
+            MixBlocksFn mixBlocks = MixBlocksFor(impls[i]);
+
+            for (size_t length = 0; length < count; ++length)
+            {
+                uint64 hash1 = 0, hash2 = 0;
+                Hash128With(mixBlocks, message, length, &hash1, &hash2);
+                hashes[2*length] = hash1;
+                hashes[2*length+1] = hash2;
+            }
+            ok = ok && VerifyHashes(&hashes[0], hashes.size());
+        }
+
+        // in two pieces, so the second starts part way into a block
+        for (size_t length = 0; length < count; ++length)
+        {
+            SpookyHash state;
+            uint64 hash1, hash2;
+
+            state.Init(0, 0);
+            state.Update(message, length/3);
+            state.Update(message + length/3, length - length/3);
+            state.Final(&hash1, &hash2);
+            hashes[2*length] = hash1;
+            hashes[2*length+1] = hash2;
+
+            messages[length] = message;
+            lengths[length] = length;
+        }
+        ok = ok && VerifyHashes(&hashes[0], hashes.size());
+
+        Hash64Batch(&messages[0], &lengths[0], count, 0, &batch[0]);
+        for (size_t length = 0; length < count; ++length)
+            ok = ok && batch[length] == hashes[2*length];
+    }
+
+    return ok;
+}